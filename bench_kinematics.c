@@ -0,0 +1,272 @@
+#include "bench_util.h"
+#include "ik.h"
+
+// kinematics speed and IK -> FK accuracy over the leg workspace, run with `make bench`
+//
+// One "name value unit" line per metric so runs can be diffed and tracked between
+// releases; lines starting with # are comments.
+
+#define BENCH_ANGLE_RANGE 180 // servo travel in degrees
+#define BENCH_STEP 5 // degrees between grid angles
+#define BENCH_REPEAT 20 // passes over the grid per timing
+#define BENCH_REACH (COXA_LENGTH + FEMUR_LENGTH + TIBIA_LENGTH)
+#define BENCH_TARGETS_X 32 // workspace grid targets along x and y, about 10 mm apart
+#define BENCH_TARGETS_Z (2 * BENCH_TARGETS_X - 1)
+#define BENCH_TARGET_STEP (BENCH_REACH / (BENCH_TARGETS_X - 1))
+#define BENCH_TARGETS_LEG (BENCH_TARGETS_X * BENCH_TARGETS_X * BENCH_TARGETS_Z)
+#define BENCH_MAX_TRIP_ERROR 0.1 // mm, IK -> FK miss allowed on top of what the status admits
+
+typedef void (*fk_fn)(const float angles[3], LegPosition position_leg, float position[3]);
+
+// workspace grid of every leg, one run of BENCH_TARGETS_LEG targets per leg
+static float target_x[NUM_LEGS * BENCH_TARGETS_LEG];
+static float target_y[NUM_LEGS * BENCH_TARGETS_LEG];
+static float target_z[NUM_LEGS * BENCH_TARGETS_LEG];
+static LegPosition target_leg[NUM_LEGS * BENCH_TARGETS_LEG];
+static float theta1[NUM_LEGS * BENCH_TARGETS_LEG];
+static float theta2[NUM_LEGS * BENCH_TARGETS_LEG];
+static float theta3[NUM_LEGS * BENCH_TARGETS_LEG];
+static enum ik_status status[NUM_LEGS * BENCH_TARGETS_LEG];
+static float trip_err[NUM_LEGS * BENCH_TARGETS_LEG];
+
+static void report(const char *name, double value, const char *unit)
+{
+    printf("%-24s %.6g %s\n", name, value, unit);
+}
+
+/**
+ * @brief report p50, p90, p99 and max of values as name_p50 and so on.
+ */
+static void report_percentiles(const char *name, float *values, int count, const char *unit)
+{
+    static const char *suffix[BENCH_PERCENTILES] = { "p50", "p90", "p99", "max" };
+    float value[BENCH_PERCENTILES];
+    char key[64];
+
+    percentiles(values, count, value);
+    for (int i = 0; i < BENCH_PERCENTILES; i++) {
+        snprintf(key, sizeof(key), "%s_%s", name, suffix[i]);
+        report(key, value[i], unit);
+    }
+}
+
+/**
+ * @brief run fk over the servo angle grid of every leg.
+ *
+ * @param fk implementation.
+ * @param sink accumulated coordinates, keeps the calls from being optimised away.
+ * @return calls made.
+ */
+static long run_grid(fk_fn fk, float *sink)
+{
+    long calls = 0;
+    float position[3];
+    for (int leg = 0; leg < NUM_LEGS; leg++) {
+        for (int a0 = 0; a0 <= BENCH_ANGLE_RANGE; a0 += BENCH_STEP) {
+            for (int a1 = 0; a1 <= BENCH_ANGLE_RANGE; a1 += BENCH_STEP) {
+                for (int a2 = 0; a2 <= BENCH_ANGLE_RANGE; a2 += BENCH_STEP) {
+                    float angles[3] = { a0, a1, a2 };
+                    fk(angles, (LegPosition)leg, position);
+                    *sink += position[0] + position[1] + position[2];
+                    calls++;
+                }
+            }
+        }
+    }
+    return calls;
+}
+
+static double time_fk(fk_fn fk, float *sink)
+{
+    long calls = 0;
+    double start = now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++) {
+        calls += run_grid(fk, sink);
+    }
+    return (now_ns() - start) / calls;
+}
+
+/**
+ * @brief largest distance between fk and the GSL reference over the grid.
+ */
+static float max_error(fk_fn fk)
+{
+    float worst = 0.0f;
+    float ref[3], position[3];
+    for (int leg = 0; leg < NUM_LEGS; leg++) {
+        for (int a0 = 0; a0 <= BENCH_ANGLE_RANGE; a0 += BENCH_STEP) {
+            for (int a1 = 0; a1 <= BENCH_ANGLE_RANGE; a1 += BENCH_STEP) {
+                for (int a2 = 0; a2 <= BENCH_ANGLE_RANGE; a2 += BENCH_STEP) {
+                    float angles[3] = { a0, a1, a2 };
+                    forward_kinematics_gsl(angles, (LegPosition)leg, ref);
+                    fk(angles, (LegPosition)leg, position);
+                    float dx = position[0] - ref[0];
+                    float dy = position[1] - ref[1];
+                    float dz = position[2] - ref[2];
+                    float err = sqrtf(dx * dx + dy * dy + dz * dz);
+                    if (err > worst) {
+                        worst = err;
+                    }
+                }
+            }
+        }
+    }
+    return worst;
+}
+
+/**
+ * @brief time calculate_DH_transformation() alone, matrix allocated once.
+ */
+static double time_dh_transformation(float *sink)
+{
+    const float k = M_PI / 180.0f; // rad per degree
+    DHParameters params[NUM_LINKS];
+    gsl_matrix *result = gsl_matrix_alloc(4, 4);
+    long calls = 0;
+
+    double start = now_ns();
+    for (int a0 = 0; a0 <= BENCH_ANGLE_RANGE; a0 += BENCH_STEP) {
+        for (int a1 = 0; a1 <= BENCH_ANGLE_RANGE; a1 += BENCH_STEP) {
+            for (int a2 = 0; a2 <= BENCH_ANGLE_RANGE; a2 += BENCH_STEP) {
+                init_DH_params(&params[0], 90.0 * k, COXA_LENGTH, 0.0, (a0 + 90.0) * k);
+                init_DH_params(&params[1], 0.0, FEMUR_LENGTH, 0.0, (a1 - 90.0) * k);
+                init_DH_params(&params[2], -90.0 * k, TIBIA_LENGTH, 0.0, -a2 * k);
+                init_DH_params(&params[3], 90.0 * k, 0.0, 0.0, -90.0 * k);
+                calculate_DH_transformation(params, NUM_LINKS, result);
+                *sink += gsl_matrix_get(result, 0, 3);
+                calls++;
+            }
+        }
+    }
+    double ns = (now_ns() - start) / calls;
+
+    gsl_matrix_free(result);
+    return ns;
+}
+
+/**
+ * @brief distance from target i to the foot position of its solved angles.
+ */
+static float trip_error(int i)
+{
+    float angles[3] = { theta1[i], theta2[i], theta3[i] };
+    float position[3];
+    forward_kinematics_position(angles, target_leg[i], position);
+    float dx = position[0] - target_x[i];
+    float dy = position[1] - target_y[i];
+    float dz = position[2] - target_z[i];
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+/**
+ * @brief fill the workspace grid of every leg: x and y in [0, BENCH_REACH], z in
+ * [-BENCH_REACH, BENCH_REACH].
+ *
+ * @return number of targets.
+ */
+static int build_targets(void)
+{
+    int n = 0;
+    for (int leg = 0; leg < NUM_LEGS; leg++) {
+        for (int i = 0; i < BENCH_TARGETS_X; i++) {
+            for (int j = 0; j < BENCH_TARGETS_X; j++) {
+                for (int k = 0; k < BENCH_TARGETS_Z; k++) {
+                    target_x[n] = i * BENCH_TARGET_STEP;
+                    target_y[n] = j * BENCH_TARGET_STEP;
+                    target_z[n] = (k - (BENCH_TARGETS_X - 1)) * BENCH_TARGET_STEP;
+                    target_leg[n] = (LegPosition)leg;
+                    n++;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+int main(void)
+{
+    float sink = 0.0f;
+
+    // forward kinematics over the servo angle grid
+    double gsl_ns = time_fk(forward_kinematics_gsl, &sink);
+    double dh_ns = time_fk(forward_kinematics_dh, &sink);
+    double closed_ns = time_fk(forward_kinematics_position, &sink);
+    double transformation_ns = time_dh_transformation(&sink);
+
+    printf("# forward kinematics, %d degree servo grid, %d legs\n", BENCH_STEP, NUM_LEGS);
+    report("fk_gsl_ns", gsl_ns, "ns/call");
+    report("fk_dh_ns", dh_ns, "ns/call");
+    report("fk_closed_ns", closed_ns, "ns/call");
+    report("dh_transformation_ns", transformation_ns, "ns/call");
+    report("fk_dh_max_error", max_error(forward_kinematics_dh), "mm");
+    report("fk_closed_max_error", max_error(forward_kinematics_position), "mm");
+
+    // inverse kinematics over the workspace grid
+    int count = build_targets();
+    long calls = 0;
+    double start = now_ns();
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        for (int i = 0; i < count; i++) {
+            float target[3] = { target_x[i], target_y[i], target_z[i] };
+            float angles[3];
+            ik_solve(target, target_leg[i], angles);
+            sink += angles[0];
+            calls++;
+        }
+    }
+    double solve_ns = (now_ns() - start) / calls;
+
+    start = now_ns();
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        inverse_kinematics_batch(target_x, target_y, target_z, target_leg, count, theta1, theta2,
+                                 theta3, status);
+        sink += theta1[r];
+    }
+    double batch_ns = (now_ns() - start) / ((double)count * BENCH_REPEAT);
+
+    // IK -> FK round trip: exact on reachable targets, within the margin on clamped ones
+    int reachable = 0, clamped = 0, out = 0;
+    float reachable_max = 0.0f, clamped_max = 0.0f;
+    for (int i = 0; i < count; i++) {
+        if (status[i] == IK_CLAMPED) {
+            clamped++;
+            clamped_max = fmaxf(clamped_max, trip_error(i));
+        }
+        if (status[i] == IK_OUT_OF_WORKSPACE) {
+            out++;
+        }
+        if (status[i] != IK_REACHABLE) {
+            continue;
+        }
+        trip_err[reachable] = trip_error(i);
+        reachable_max = fmaxf(reachable_max, trip_err[reachable]);
+        reachable++;
+    }
+
+    printf("# inverse kinematics, %.1f mm workspace grid, %d legs\n", BENCH_TARGET_STEP,
+           NUM_LEGS);
+    report("ik_solve_ns", solve_ns, "ns/call");
+    report("ik_batch_ns", batch_ns, "ns/target");
+    report("ik_targets", count, "targets");
+    report("ik_reachable", reachable, "targets");
+    report("ik_clamped", clamped, "targets");
+    report("ik_out_of_workspace", out, "targets");
+    report_percentiles("ik_fk_error", trip_err, reachable, "mm");
+    report("ik_clamped_error_max", clamped_max, "mm");
+
+    printf("# checksum %g\n", sink);
+
+    // a status of IK_REACHABLE or IK_CLAMPED is a promise about where the foot ends up
+    int failed = 0;
+    if (reachable_max > BENCH_MAX_TRIP_ERROR) {
+        fprintf(stderr, "FAIL reachable targets missed by up to %g mm (limit %g mm)\n",
+                reachable_max, BENCH_MAX_TRIP_ERROR);
+        failed = 1;
+    }
+    if (clamped_max > IK_CLAMP_MARGIN + BENCH_MAX_TRIP_ERROR) {
+        fprintf(stderr, "FAIL clamped targets missed by up to %g mm (limit %g mm)\n", clamped_max,
+                IK_CLAMP_MARGIN + BENCH_MAX_TRIP_ERROR);
+        failed = 1;
+    }
+    return failed;
+}
@@ -0,0 +1,41 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <time.h>
+#include "bench_util.h"
+
+/**
+ * @brief monotonic clock in nanoseconds.
+ */
+double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief qsort() order of floats, ascending.
+ */
+int compare_float(const void *a, const void *b)
+{
+    float fa = *(const float *)a, fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+/**
+ * @brief p50, p90, p99 and max of values.
+ *
+ * @param values samples, sorted in place.
+ * @param count number of samples, all results are 0 without any.
+ * @param out percentiles in that order.
+ */
+void percentiles(float *values, int count, float out[BENCH_PERCENTILES])
+{
+    static const int per_mille[BENCH_PERCENTILES] = { 500, 900, 990, 1000 };
+
+    qsort(values, count, sizeof(float), compare_float);
+    for (int i = 0; i < BENCH_PERCENTILES; i++) {
+        int index = (int)((long)count * per_mille[i] / 1000);
+        out[i] = count ? values[index < count ? index : count - 1] : 0.0f;
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+// helpers shared by the benchmark and report programs, not part of the robot build
+
+#define BENCH_PERCENTILES 4 // p50, p90, p99, max
+
+double now_ns(void);
+int compare_float(const void *a, const void *b);
+void percentiles(float *values, int count, float out[BENCH_PERCENTILES]);
+
+#endif // BENCH_UTIL_H
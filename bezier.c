@@ -1,128 +1,825 @@
+#include <math.h>
+#include <stdio.h>
 #include "bezier.h"
 
+// a sampler parameter this close to 1 has wrapped, as fmod() of the exact grid would
+#define BEZIER_WRAP_TOLERANCE 1e-9
+
+/**
+ * @brief power basis coefficients of one coordinate of a Bezier curve.
+ *
+ * coef[k] = C(n, k) * sum_i (-1)^(k - i) * C(k, i) * points[i] for degree n, so the
+ * curve is the polynomial sum coef[k] * t^k. Summed in double, the alternating terms
+ * cancel.
+ *
+ * @param points control point coordinates.
+ * @param stride floats between consecutive points and coefficients.
+ * @param npoints number of control points (degree + 1).
+ * @param coef coefficients, out.
+ */
+static void power_basis(const float *points, int stride, int npoints, float *coef)
+{
+    int degree = npoints - 1;
+    double degree_choose_k = 1.0;
+
+    for (int k = 0; k < npoints; k++) {
+        double sum = 0.0;
+        double k_choose_i = 1.0;
+        for (int i = 0; i <= k; i++) {
+            sum += ((k - i) % 2 ? -k_choose_i : k_choose_i) * points[i * stride];
+            k_choose_i = k_choose_i * (k - i) / (i + 1);
+        }
+        coef[k * stride] = degree_choose_k * sum;
+        degree_choose_k = degree_choose_k * (degree - k) / (k + 1);
+    }
+}
+
+/**
+ * @brief evaluate sum coef[k] * t^k with Horner's method.
+ */
+static inline float horner(const float *coef, int stride, int ncoef, float t)
+{
+    float value = coef[(ncoef - 1) * stride];
+    for (int k = ncoef - 2; k >= 0; k--) {
+        value = value * t + coef[k * stride];
+    }
+    return value;
+}
+
+/**
+ * @brief forward differences of one coordinate at t0 with step h.
+ *
+ * Worked out from the coefficients rather than by differencing samples, which would
+ * cancel to noise in the high orders: shift the polynomial to q(s) = p(t0 + h * s), then
+ * the k-th difference of s^j at 0 is k! * S(j, k) with S the Stirling numbers of the
+ * second kind. The highest order difference is constant along the curve.
+ *
+ * @param coef power basis coefficients.
+ * @param stride floats between consecutive coefficients.
+ * @param ncoef number of coefficients (degree + 1), at most BEZIER_SAMPLER_MAX_POINTS.
+ * @param t0 first parameter.
+ * @param h step between parameters.
+ * @param diff differences of order 0..degree, out.
+ */
+static void differences_init(const float *coef, int stride, int ncoef, double t0, double h,
+                             double *diff)
+{
+    double q[BEZIER_SAMPLER_MAX_POINTS];
+    double stirling[BEZIER_SAMPLER_MAX_POINTS] = { 1.0 }; // S(j, k) of the current j
+
+    // Taylor shift by t0 with repeated synthetic division
+    for (int j = 0; j < ncoef; j++) {
+        q[j] = coef[j * stride];
+    }
+    for (int i = 0; i < ncoef - 1; i++) {
+        for (int j = ncoef - 2; j >= i; j--) {
+            q[j] += t0 * q[j + 1];
+        }
+    }
+
+    double h_power = 1.0;
+    for (int k = 0; k < ncoef; k++) {
+        diff[k] = 0.0;
+    }
+    for (int j = 0; j < ncoef; j++) {
+        if (j > 0) {
+            // S(j, k) = k * S(j - 1, k) + S(j - 1, k - 1)
+            for (int k = j; k >= 1; k--) {
+                stirling[k] = k * stirling[k] + stirling[k - 1];
+            }
+            stirling[0] = 0.0;
+        }
+        double b = q[j] * h_power;
+        double k_factorial = 1.0;
+        for (int k = 0; k <= j; k++) {
+            if (k > 0) {
+                k_factorial *= k;
+            }
+            diff[k] += b * k_factorial * stirling[k];
+        }
+        h_power *= h;
+    }
+}
+
+/**
+ * @brief move the differences one step along the curve, additions only.
+ */
+static inline void differences_step(double *diff, int ncoef)
+{
+    for (int k = 0; k < ncoef - 1; k++) {
+        diff[k] += diff[k + 1];
+    }
+}
+
+/**
+ * @brief invert the cumulative chord lengths of a curve into t at even distances.
+ *
+ * @param arc table to fill.
+ * @param distance distance along the curve at t = j / nsteps, j = 0..nsteps.
+ * @param nsteps number of chords.
+ */
+void bezier_arc_init(struct bezier_arc *arc, const float *distance, int nsteps)
+{
+    arc->length = distance[nsteps];
+    if (arc->length <= 0.0f) {
+        for (int i = 0; i <= BEZIER_ARC_SAMPLES; i++) {
+            arc->t[i] = (float)i / BEZIER_ARC_SAMPLES;
+        }
+        return;
+    }
+
+    int j = 0;
+    for (int i = 0; i < BEZIER_ARC_SAMPLES; i++) {
+        float target = arc->length * i / BEZIER_ARC_SAMPLES;
+        while (j < nsteps - 1 && distance[j + 1] < target) {
+            j++;
+        }
+        float chord = distance[j + 1] - distance[j];
+        float frac = chord > 0.0f ? (target - distance[j]) / chord : 0.0f;
+        arc->t[i] = (j + frac) / nsteps;
+    }
+    arc->t[BEZIER_ARC_SAMPLES] = 1.0f;
+}
+
+/**
+ * @brief t at a distance along the curve, O(1) interpolation in the arc table.
+ *
+ * @param arc arc table of the curve.
+ * @param distance distance from the start, clamped to [0, length].
+ * @return t in [0, 1].
+ */
+float bezier_arc_lookup(const struct bezier_arc *arc, float distance)
+{
+    if (arc->length <= 0.0f) {
+        return 0.0f;
+    }
+    float u = distance / arc->length * BEZIER_ARC_SAMPLES;
+    u = fmaxf(0.0f, fminf(u, BEZIER_ARC_SAMPLES));
+    int i = (int)u;
+    if (i == BEZIER_ARC_SAMPLES) {
+        i--;
+    }
+    return arc->t[i] + (arc->t[i + 1] - arc->t[i]) * (u - i);
+}
+
+static float default_arena_storage[BEZIER_ARENA_FLOATS];
+
+// arena of curves made without one
+struct bezier_arena bezier_default_arena = { default_arena_storage, BEZIER_ARENA_FLOATS, 0 };
+
+/**
+ * @brief set up an arena over caller owned storage.
+ *
+ * @param arena arena to set up.
+ * @param storage floats the curves are stored in, must outlive the arena.
+ * @param capacity number of floats in storage.
+ */
+void bezier_arena_init(struct bezier_arena *arena, float *storage, int capacity)
+{
+    arena->data = storage;
+    arena->capacity = capacity;
+    arena->used = 0;
+}
+
+/**
+ * @brief release every curve in the arena at once.
+ *
+ * Curves stored in it must be initialised again before they are used.
+ */
+void bezier_arena_reset(struct bezier_arena *arena)
+{
+    arena->used = 0;
+}
+
+/**
+ * @brief make room for one more point record at the end of a curve.
+ *
+ * Grows the curve in place when it is the newest block of the arena, otherwise moves
+ * its records to the end first; the space it leaves is reclaimed by the next reset.
+ *
+ * @param arena arena of the curve.
+ * @param points records of the curve, updated when they move.
+ * @param npoints number of records.
+ * @param stride floats per record.
+ * @return the new record, NULL when the arena is full.
+ */
+static float *arena_append(struct bezier_arena *arena, float **points, int npoints, int stride)
+{
+    float *end = arena->data + arena->used;
+    int moving = *points == NULL || *points + npoints * stride != end;
+    int need = (moving ? npoints + 1 : 1) * stride;
+
+    if (arena->used + need > arena->capacity) {
+        return NULL;
+    }
+    if (moving) {
+        if (npoints > 0) {
+            memcpy(end, *points, npoints * stride * sizeof(float));
+        }
+        *points = end;
+    }
+    arena->used += need;
+    return *points + npoints * stride;
+}
+
+/**
+ * @brief give the records of a curve back to the arena if nothing was stored after them.
+ */
+static void arena_release(struct bezier_arena *arena, float *points, int npoints, int stride)
+{
+    if (points != NULL && points + npoints * stride == arena->data + arena->used) {
+        arena->used -= npoints * stride;
+    }
+}
+
 void bezier2d_init(struct bezier2d *curve)
 {
-    curve->xpos = NULL;
-    curve->ypos = NULL;
+    bezier2d_init_arena(curve, &bezier_default_arena);
+}
+
+/**
+ * @brief start an empty curve whose control points are stored in arena.
+ */
+void bezier2d_init_arena(struct bezier2d *curve, struct bezier_arena *arena)
+{
+    curve->arena = arena;
+    curve->points = NULL;
     curve->npoints = 0;
+    curve->finalized = 0;
+    curve->arc_ready = 0;
 }
 
-void bezier2d_addPoint(struct bezier2d *curve, float x, float y)
+/**
+ * @brief append a control point.
+ *
+ * A full arena is an error the caller has to handle: the curve is left as it was, and
+ * evaluating it would follow a different path. Release the curves of the previous gait
+ * generation with bezier_arena_reset() before building the next one.
+ *
+ * @param curve curve to extend.
+ * @param x, y control point.
+ * @return 0, -1 if the arena is full and the point was not added.
+ */
+int bezier2d_addPoint(struct bezier2d *curve, float x, float y)
 {
+    float *record = arena_append(curve->arena, &curve->points, curve->npoints, BEZIER2D_STRIDE);
+    if (record == NULL) {
+        fprintf(stderr, "bezier2d: arena full\n");
+        return -1;
+    }
+    record[0] = x;
+    record[1] = y;
     curve->npoints++;
-    curve->xpos = (float *)realloc(curve->xpos, curve->npoints * sizeof(float));
-    curve->ypos = (float *)realloc(curve->ypos, curve->npoints * sizeof(float));
-    curve->xpos[curve->npoints - 1] = x;
-    curve->ypos[curve->npoints - 1] = y;
+    curve->finalized = 0;
+    curve->arc_ready = 0;
+    return 0;
 }
 
-void bezier2d_getPos(struct bezier2d *curve, float t, float *xret, float *yret)
+/**
+ * @brief compute the power basis coefficients after the last control point is added.
+ *
+ * Called by the evaluation functions when points were added since, so calling it is
+ * only needed to keep that work out of the first evaluation.
+ *
+ * @param curve curve to finalize.
+ */
+void bezier2d_finalize(struct bezier2d *curve)
 {
-    int ii, ij;
-    float *x, *y;
+    if (curve->npoints > 0) {
+        power_basis(curve->points, BEZIER2D_STRIDE, curve->npoints, &curve->points[2]);
+        power_basis(&curve->points[1], BEZIER2D_STRIDE, curve->npoints, &curve->points[3]);
+    }
+    curve->finalized = 1;
+}
 
+void bezier2d_getPos(struct bezier2d *curve, float t, float *xret, float *yret)
+{
     if (curve->npoints == 0) {
         *xret = 0;
         *yret = 0;
         return;
     }
+    if (!curve->finalized) {
+        bezier2d_finalize(curve);
+    }
+
+    *xret = horner(&curve->points[2], BEZIER2D_STRIDE, curve->npoints, t);
+    *yret = horner(&curve->points[3], BEZIER2D_STRIDE, curve->npoints, t);
+}
+
+/**
+ * @brief evaluate one curve at many parameters.
+ *
+ * @param curve curve.
+ * @param t parameters in [0, 1].
+ * @param count number of parameters.
+ * @param xret x at every parameter, out.
+ * @param yret y at every parameter, out.
+ */
+void bezier2d_getPos_batch(struct bezier2d *curve, const float *t, int count, float *xret,
+                           float *yret)
+{
+    if (curve->npoints == 0) {
+        memset(xret, 0, count * sizeof(float));
+        memset(yret, 0, count * sizeof(float));
+        return;
+    }
+    if (!curve->finalized) {
+        bezier2d_finalize(curve);
+    }
+
+    for (int i = 0; i < count; i++) {
+        xret[i] = horner(&curve->points[2], BEZIER2D_STRIDE, curve->npoints, t[i]);
+        yret[i] = horner(&curve->points[3], BEZIER2D_STRIDE, curve->npoints, t[i]);
+    }
+}
+
+/**
+ * @brief evaluate many curves, curve i at parameter t[i].
+ *
+ * @param curves curves.
+ * @param t parameter of every curve.
+ * @param count number of curves.
+ * @param xret x of every curve, out.
+ * @param yret y of every curve, out.
+ */
+void bezier2d_getPos_curves(struct bezier2d *curves, const float *t, int count, float *xret,
+                            float *yret)
+{
+    for (int i = 0; i < count; i++) {
+        bezier2d_getPos(&curves[i], t[i], &xret[i], &yret[i]);
+    }
+}
+
+void bezier2d_free(struct bezier2d *curve)
+{
+    arena_release(curve->arena, curve->points, curve->npoints, BEZIER2D_STRIDE);
+    bezier2d_init_arena(curve, curve->arena);
+}
+
+/**
+ * @brief set up uniform sampling of a curve by forward differencing.
+ *
+ * After the setup every sample costs a few additions per coordinate. Curves with more
+ * than BEZIER_SAMPLER_MAX_POINTS control points are evaluated with Horner's method.
+ *
+ * @param sampler sampler to set up.
+ * @param curve curve to sample, must outlive the sampler.
+ * @param start parameter of the first sample.
+ * @param step parameter step between samples.
+ * @param wrap non-zero to run the parameter modulo 1, as the gait phases do.
+ */
+void bezier2d_sampler_init(struct bezier2d_sampler *sampler, struct bezier2d *curve,
+                           double start, double step, int wrap)
+{
+    sampler->curve = curve;
+    sampler->start = start;
+    sampler->step = step;
+    sampler->n = 0;
+    sampler->wrap = wrap;
+
+    if (!curve->finalized) {
+        bezier2d_finalize(curve);
+    }
+    if (curve->npoints > 0 && curve->npoints <= BEZIER_SAMPLER_MAX_POINTS) {
+        differences_init(&curve->points[2], BEZIER2D_STRIDE, curve->npoints, start, step,
+                         sampler->x);
+        differences_init(&curve->points[3], BEZIER2D_STRIDE, curve->npoints, start, step,
+                         sampler->y);
+    }
+}
 
-    x = (float *)malloc(curve->npoints * sizeof(float));
-    y = (float *)malloc(curve->npoints * sizeof(float));
+/**
+ * @brief current sample, then advance by one step.
+ *
+ * @param sampler sampler set up with bezier2d_sampler_init().
+ * @param xret x, out.
+ * @param yret y, out.
+ */
+void bezier2d_sampler_next(struct bezier2d_sampler *sampler, float *xret, float *yret)
+{
+    struct bezier2d *curve = sampler->curve;
+    int npoints = curve->npoints;
 
-    // load with current points
-    for (ii = 0; ii < curve->npoints; ii++) {
-        x[ii] = curve->xpos[ii];
-        y[ii] = curve->ypos[ii];
+    if (npoints == 0 || npoints > BEZIER_SAMPLER_MAX_POINTS) {
+        bezier2d_getPos(curve, sampler->start + sampler->n * sampler->step, xret, yret);
+    } else {
+        *xret = sampler->x[0];
+        *yret = sampler->y[0];
     }
 
-    // iterate over levels
-    for (ii = 0; ii < curve->npoints - 1; ii++) {
-        for (ij = 0; ij < curve->npoints - ii - 1; ij++) {
-            x[ij] = (1.0 - t) * x[ij] + t * x[ij + 1];
-            y[ij] = (1.0 - t) * y[ij] + t * y[ij + 1];
+    sampler->n++;
+    double t = sampler->start + sampler->n * sampler->step;
+    if (sampler->wrap && t >= 1.0 - BEZIER_WRAP_TOLERANCE) {
+        // past the end of the cycle, restart the differences from the wrapped parameter
+        sampler->start -= 1.0;
+        if (npoints > 0 && npoints <= BEZIER_SAMPLER_MAX_POINTS) {
+            differences_init(&curve->points[2], BEZIER2D_STRIDE, npoints, t - 1.0, sampler->step,
+                             sampler->x);
+            differences_init(&curve->points[3], BEZIER2D_STRIDE, npoints, t - 1.0, sampler->step,
+                             sampler->y);
         }
+    } else if (npoints > 0 && npoints <= BEZIER_SAMPLER_MAX_POINTS) {
+        differences_step(sampler->x, npoints);
+        differences_step(sampler->y, npoints);
     }
+}
 
-    *xret = x[0];
-    *yret = y[0];
+/**
+ * @brief sample a curve at t = i / num_points for i = 0..num_points.
+ *
+ * @param curve curve to sample.
+ * @param num_points number of steps, num_points + 1 samples are written.
+ * @param xret x of every sample, out.
+ * @param yret y of every sample, out.
+ */
+void bezier2d_sample(struct bezier2d *curve, int num_points, float *xret, float *yret)
+{
+    struct bezier2d_sampler sampler;
+    bezier2d_sampler_init(&sampler, curve, 0.0, 1.0 / num_points, 0);
 
-    free(x);
-    free(y);
+    int npoints = curve->npoints;
+    if (npoints == 0 || npoints > BEZIER_SAMPLER_MAX_POINTS) {
+        for (int i = 0; i <= num_points; i++) {
+            bezier2d_sampler_next(&sampler, &xret[i], &yret[i]);
+        }
+        return;
+    }
+    for (int i = 0; i <= num_points; i++) {
+        xret[i] = sampler.x[0];
+        yret[i] = sampler.y[0];
+        differences_step(sampler.x, npoints);
+        differences_step(sampler.y, npoints);
+    }
 }
 
-void bezier2d_generate_curve(struct bezier2d *curve, float startx, float startz, float controlx,
-                             float controlz, float endx, float endz)
+/**
+ * @brief measure a curve and cache its arc length table.
+ *
+ * Built on first use after the control points change, from
+ * BEZIER_ARC_SAMPLES * BEZIER_ARC_SUBSTEPS chords; later lookups only read the table.
+ */
+static void bezier2d_arc_build(struct bezier2d *curve)
 {
-    bezier2d_addPoint(curve, startx, startz);
-    bezier2d_addPoint(curve, controlx, controlz);
-    bezier2d_addPoint(curve, endx, endz);
+    enum { nsteps = BEZIER_ARC_SAMPLES * BEZIER_ARC_SUBSTEPS };
+    float x[nsteps + 1], y[nsteps + 1], distance[nsteps + 1];
+
+    bezier2d_sample(curve, nsteps, x, y);
+    distance[0] = 0.0f;
+    for (int j = 1; j <= nsteps; j++) {
+        distance[j] = distance[j - 1] + hypotf(x[j] - x[j - 1], y[j] - y[j - 1]);
+    }
+    bezier_arc_init(&curve->arc, distance, nsteps);
+    curve->arc_ready = 1;
+}
+
+/**
+ * @brief length of the curve.
+ */
+float bezier2d_length(struct bezier2d *curve)
+{
+    if (!curve->arc_ready) {
+        bezier2d_arc_build(curve);
+    }
+    return curve->arc.length;
+}
+
+/**
+ * @brief curve parameter at a distance along the curve.
+ *
+ * @param curve curve.
+ * @param distance distance from the start, clamped to [0, length].
+ * @return t in [0, 1].
+ */
+float bezier2d_t_at_distance(struct bezier2d *curve, float distance)
+{
+    if (!curve->arc_ready) {
+        bezier2d_arc_build(curve);
+    }
+    return bezier_arc_lookup(&curve->arc, distance);
+}
+
+/**
+ * @brief position at a fraction of the curve length, for constant speed along it.
+ *
+ * @param curve curve.
+ * @param u fraction of the length in [0, 1], e.g. elapsed time over duration.
+ * @param xret x, out.
+ * @param yret y, out.
+ */
+void bezier2d_getPos_uniform(struct bezier2d *curve, float u, float *xret, float *yret)
+{
+    float t = bezier2d_t_at_distance(curve, u * bezier2d_length(curve));
+    bezier2d_getPos(curve, t, xret, yret);
+}
+
+int bezier2d_generate_curve(struct bezier2d *curve, float startx, float startz, float controlx,
+                            float controlz, float endx, float endz)
+{
+    if (bezier2d_addPoint(curve, startx, startz) < 0 ||
+        bezier2d_addPoint(curve, controlx, controlz) < 0 ||
+        bezier2d_addPoint(curve, endx, endz) < 0) {
+        return -1;
+    }
+    return 0;
 }
 
 void bezier3d_init(struct bezier3d *curve)
 {
-    curve->xpos = NULL;
-    curve->ypos = NULL;
-    curve->zpos = NULL;
+    bezier3d_init_arena(curve, &bezier_default_arena);
+}
+
+/**
+ * @brief start an empty curve whose control points are stored in arena.
+ */
+void bezier3d_init_arena(struct bezier3d *curve, struct bezier_arena *arena)
+{
+    curve->arena = arena;
+    curve->points = NULL;
     curve->npoints = 0;
+    curve->finalized = 0;
+    curve->arc_ready = 0;
 }
 
-void bezier3d_addpoint(struct bezier3d *curve, float x, float y, float z)
+/**
+ * @brief append a control point, see bezier2d_addPoint().
+ *
+ * @return 0, -1 if the arena is full and the point was not added.
+ */
+int bezier3d_addpoint(struct bezier3d *curve, float x, float y, float z)
 {
+    float *record = arena_append(curve->arena, &curve->points, curve->npoints, BEZIER3D_STRIDE);
+    if (record == NULL) {
+        fprintf(stderr, "bezier3d: arena full\n");
+        return -1;
+    }
+    record[0] = x;
+    record[1] = y;
+    record[2] = z;
     curve->npoints++;
-    curve->xpos = (float *)realloc(curve->xpos, curve->npoints * sizeof(float));
-    curve->ypos = (float *)realloc(curve->ypos, curve->npoints * sizeof(float));
-    curve->zpos = (float *)realloc(curve->zpos, curve->npoints * sizeof(float));
-    curve->xpos[curve->npoints - 1] = x;
-    curve->ypos[curve->npoints - 1] = y;
-    curve->zpos[curve->npoints - 1] = z;
+    curve->finalized = 0;
+    curve->arc_ready = 0;
+    return 0;
 }
 
-void bezier3d_getpos(struct bezier3d *curve, float t, float *xret, float *yret, float *zret)
+/**
+ * @brief compute the power basis coefficients, see bezier2d_finalize().
+ *
+ * @param curve curve to finalize.
+ */
+void bezier3d_finalize(struct bezier3d *curve)
 {
-    int ii, ij;
-    float *x, *y, *z;
+    if (curve->npoints > 0) {
+        power_basis(curve->points, BEZIER3D_STRIDE, curve->npoints, &curve->points[3]);
+        power_basis(&curve->points[1], BEZIER3D_STRIDE, curve->npoints, &curve->points[4]);
+        power_basis(&curve->points[2], BEZIER3D_STRIDE, curve->npoints, &curve->points[5]);
+    }
+    curve->finalized = 1;
+}
 
+void bezier3d_getpos(struct bezier3d *curve, float t, float *xret, float *yret, float *zret)
+{
     if (curve->npoints == 0) {
         *xret = 0;
         *yret = 0;
         *zret = 0;
         return;
     }
+    if (!curve->finalized) {
+        bezier3d_finalize(curve);
+    }
 
-    x = (float *)malloc(curve->npoints * sizeof(float));
-    y = (float *)malloc(curve->npoints * sizeof(float));
-    z = (float *)malloc(curve->npoints * sizeof(float));
+    *xret = horner(&curve->points[3], BEZIER3D_STRIDE, curve->npoints, t);
+    *yret = horner(&curve->points[4], BEZIER3D_STRIDE, curve->npoints, t);
+    *zret = horner(&curve->points[5], BEZIER3D_STRIDE, curve->npoints, t);
+}
 
-    // load with the current points
-    for (ii = 0; ii < curve->npoints; ii++) {
-        x[ii] = curve->xpos[ii];
-        y[ii] = curve->ypos[ii];
-        z[ii] = curve->zpos[ii];
+/**
+ * @brief evaluate one curve at many parameters.
+ *
+ * @param curve curve.
+ * @param t parameters in [0, 1].
+ * @param count number of parameters.
+ * @param xret x at every parameter, out.
+ * @param yret y at every parameter, out.
+ * @param zret z at every parameter, out.
+ */
+void bezier3d_getpos_batch(struct bezier3d *curve, const float *t, int count, float *xret,
+                           float *yret, float *zret)
+{
+    if (curve->npoints == 0) {
+        memset(xret, 0, count * sizeof(float));
+        memset(yret, 0, count * sizeof(float));
+        memset(zret, 0, count * sizeof(float));
+        return;
+    }
+    if (!curve->finalized) {
+        bezier3d_finalize(curve);
     }
 
-    // iterate over levels
-    for (ii = 0; ii < curve->npoints - 1; ii++) {
-        for (ij = 0; ij < curve->npoints - ii - 1; ij++) {
-            x[ij] = (1.0 - t) * x[ij] + t * x[ij + 1];
-            y[ij] = (1.0 - t) * y[ij] + t * y[ij + 1];
-            z[ij] = (1.0 - t) * z[ij] + t * z[ij + 1];
+    for (int i = 0; i < count; i++) {
+        xret[i] = horner(&curve->points[3], BEZIER3D_STRIDE, curve->npoints, t[i]);
+        yret[i] = horner(&curve->points[4], BEZIER3D_STRIDE, curve->npoints, t[i]);
+        zret[i] = horner(&curve->points[5], BEZIER3D_STRIDE, curve->npoints, t[i]);
+    }
+}
+
+/**
+ * @brief evaluate many curves, curve i at parameter t[i].
+ *
+ * @param curves curves.
+ * @param t parameter of every curve.
+ * @param count number of curves.
+ * @param xret x of every curve, out.
+ * @param yret y of every curve, out.
+ * @param zret z of every curve, out.
+ */
+void bezier3d_getpos_curves(struct bezier3d *curves, const float *t, int count, float *xret,
+                            float *yret, float *zret)
+{
+    for (int i = 0; i < count; i++) {
+        bezier3d_getpos(&curves[i], t[i], &xret[i], &yret[i], &zret[i]);
+    }
+}
+
+void bezier3d_free(struct bezier3d *curve)
+{
+    arena_release(curve->arena, curve->points, curve->npoints, BEZIER3D_STRIDE);
+    bezier3d_init_arena(curve, curve->arena);
+}
+
+/**
+ * @brief set up uniform sampling of a curve, see bezier2d_sampler_init().
+ *
+ * @param sampler sampler to set up.
+ * @param curve curve to sample, must outlive the sampler.
+ * @param start parameter of the first sample.
+ * @param step parameter step between samples.
+ * @param wrap non-zero to run the parameter modulo 1.
+ */
+void bezier3d_sampler_init(struct bezier3d_sampler *sampler, struct bezier3d *curve,
+                           double start, double step, int wrap)
+{
+    sampler->curve = curve;
+    sampler->start = start;
+    sampler->step = step;
+    sampler->n = 0;
+    sampler->wrap = wrap;
+
+    if (!curve->finalized) {
+        bezier3d_finalize(curve);
+    }
+    if (curve->npoints > 0 && curve->npoints <= BEZIER_SAMPLER_MAX_POINTS) {
+        differences_init(&curve->points[3], BEZIER3D_STRIDE, curve->npoints, start, step,
+                         sampler->x);
+        differences_init(&curve->points[4], BEZIER3D_STRIDE, curve->npoints, start, step,
+                         sampler->y);
+        differences_init(&curve->points[5], BEZIER3D_STRIDE, curve->npoints, start, step,
+                         sampler->z);
+    }
+}
+
+/**
+ * @brief current sample, then advance by one step.
+ *
+ * @param sampler sampler set up with bezier3d_sampler_init().
+ * @param xret x, out.
+ * @param yret y, out.
+ * @param zret z, out.
+ */
+void bezier3d_sampler_next(struct bezier3d_sampler *sampler, float *xret, float *yret,
+                           float *zret)
+{
+    struct bezier3d *curve = sampler->curve;
+    int npoints = curve->npoints;
+
+    if (npoints == 0 || npoints > BEZIER_SAMPLER_MAX_POINTS) {
+        bezier3d_getpos(curve, sampler->start + sampler->n * sampler->step, xret, yret, zret);
+    } else {
+        *xret = sampler->x[0];
+        *yret = sampler->y[0];
+        *zret = sampler->z[0];
+    }
+
+    sampler->n++;
+    double t = sampler->start + sampler->n * sampler->step;
+    if (sampler->wrap && t >= 1.0 - BEZIER_WRAP_TOLERANCE) {
+        sampler->start -= 1.0;
+        if (npoints > 0 && npoints <= BEZIER_SAMPLER_MAX_POINTS) {
+            differences_init(&curve->points[3], BEZIER3D_STRIDE, npoints, t - 1.0, sampler->step,
+                             sampler->x);
+            differences_init(&curve->points[4], BEZIER3D_STRIDE, npoints, t - 1.0, sampler->step,
+                             sampler->y);
+            differences_init(&curve->points[5], BEZIER3D_STRIDE, npoints, t - 1.0, sampler->step,
+                             sampler->z);
+        }
+    } else if (npoints > 0 && npoints <= BEZIER_SAMPLER_MAX_POINTS) {
+        differences_step(sampler->x, npoints);
+        differences_step(sampler->y, npoints);
+        differences_step(sampler->z, npoints);
+    }
+}
+
+/**
+ * @brief sample a curve at t = i / num_points for i = 0..num_points.
+ *
+ * @param curve curve to sample.
+ * @param num_points number of steps, num_points + 1 samples are written.
+ * @param xret x of every sample, out.
+ * @param yret y of every sample, out.
+ * @param zret z of every sample, out.
+ */
+void bezier3d_sample(struct bezier3d *curve, int num_points, float *xret, float *yret,
+                     float *zret)
+{
+    struct bezier3d_sampler sampler;
+    bezier3d_sampler_init(&sampler, curve, 0.0, 1.0 / num_points, 0);
+
+    int npoints = curve->npoints;
+    if (npoints == 0 || npoints > BEZIER_SAMPLER_MAX_POINTS) {
+        for (int i = 0; i <= num_points; i++) {
+            bezier3d_sampler_next(&sampler, &xret[i], &yret[i], &zret[i]);
         }
+        return;
+    }
+    for (int i = 0; i <= num_points; i++) {
+        xret[i] = sampler.x[0];
+        yret[i] = sampler.y[0];
+        zret[i] = sampler.z[0];
+        differences_step(sampler.x, npoints);
+        differences_step(sampler.y, npoints);
+        differences_step(sampler.z, npoints);
+    }
+}
+
+/**
+ * @brief measure a curve and cache its arc length table, see bezier2d_arc_build().
+ */
+static void bezier3d_arc_build(struct bezier3d *curve)
+{
+    enum { nsteps = BEZIER_ARC_SAMPLES * BEZIER_ARC_SUBSTEPS };
+    float x[nsteps + 1], y[nsteps + 1], z[nsteps + 1], distance[nsteps + 1];
+
+    bezier3d_sample(curve, nsteps, x, y, z);
+    distance[0] = 0.0f;
+    for (int j = 1; j <= nsteps; j++) {
+        float dx = x[j] - x[j - 1], dy = y[j] - y[j - 1], dz = z[j] - z[j - 1];
+        distance[j] = distance[j - 1] + sqrtf(dx * dx + dy * dy + dz * dz);
+    }
+    bezier_arc_init(&curve->arc, distance, nsteps);
+    curve->arc_ready = 1;
+}
+
+/**
+ * @brief length of the curve.
+ */
+float bezier3d_length(struct bezier3d *curve)
+{
+    if (!curve->arc_ready) {
+        bezier3d_arc_build(curve);
     }
+    return curve->arc.length;
+}
 
-    *xret = x[0];
-    *yret = y[0];
-    *zret = z[0];
+/**
+ * @brief curve parameter at a distance along the curve.
+ *
+ * @param curve curve.
+ * @param distance distance from the start, clamped to [0, length].
+ * @return t in [0, 1].
+ */
+float bezier3d_t_at_distance(struct bezier3d *curve, float distance)
+{
+    if (!curve->arc_ready) {
+        bezier3d_arc_build(curve);
+    }
+    return bezier_arc_lookup(&curve->arc, distance);
+}
 
-    free(x);
-    free(y);
-    free(z);
+/**
+ * @brief position at a fraction of the curve length, for constant speed along it.
+ *
+ * @param curve curve.
+ * @param u fraction of the length in [0, 1].
+ * @param xret x, out.
+ * @param yret y, out.
+ * @param zret z, out.
+ */
+void bezier3d_getpos_uniform(struct bezier3d *curve, float u, float *xret, float *yret,
+                             float *zret)
+{
+    float t = bezier3d_t_at_distance(curve, u * bezier3d_length(curve));
+    bezier3d_getpos(curve, t, xret, yret, zret);
 }
-void bezier3d_generate_curve(struct bezier3d *curve, float startx, float starty, float startz,
-                             float controlx, float controly, float controlz, float endx, float endy,
-                             float endz)
+
+int bezier3d_generate_curve(struct bezier3d *curve, float startx, float starty, float startz,
+                            float controlx, float controly, float controlz, float endx, float endy,
+                            float endz)
 {
-    bezier3d_addpoint(curve, startx, starty, startz);
-    bezier3d_addpoint(curve, controlx, controly, controlz);
-    bezier3d_addpoint(curve, endx, endy, endz);
-}
\ No newline at end of file
+    if (bezier3d_addpoint(curve, startx, starty, startz) < 0 ||
+        bezier3d_addpoint(curve, controlx, controly, controlz) < 0 ||
+        bezier3d_addpoint(curve, endx, endy, endz) < 0) {
+        return -1;
+    }
+    return 0;
+}
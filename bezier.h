@@ -3,35 +3,132 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
+#define BEZIER_ARC_SAMPLES 64 // entries - 1 of the arc length table
+#define BEZIER_ARC_SUBSTEPS 4 // chords per table entry when measuring the curve
+
+/* Arc length parameterisation of a curve: t at evenly spaced distances along it */
+struct bezier_arc
+{
+    float length;
+    float t[BEZIER_ARC_SAMPLES + 1]; // t at distance i * length / BEZIER_ARC_SAMPLES
+};
+
+#define BEZIER_ARENA_FLOATS 4096 // capacity of the default curve arena
+#define BEZIER2D_STRIDE 4 // floats per point record: x, y, x coef, y coef
+#define BEZIER3D_STRIDE 6 // x, y, z, x coef, y coef, z coef
+
+/* Fixed storage the curves take their point records from, emptied in one go with
+ * bezier_arena_reset(); adding a point to a full arena fails */
+struct bezier_arena
+{
+    float *data;
+    int capacity; // floats
+    int used;
+};
+
+/* View of a curve in an arena: one record per control point holding the point and the
+ * power basis coefficient of the same index, B(t) = sum coef[k] * t^k */
 struct bezier2d
 {
-    float *xpos;
-    float *ypos;
+    struct bezier_arena *arena;
+    float *points; // npoints records of BEZIER2D_STRIDE floats
     int npoints;
+    int finalized; // coefficients match the control points
+    int arc_ready; // arc table matches the control points
+    struct bezier_arc arc;
 };
 
 struct bezier3d
 {
-    float *xpos;
-    float *ypos;
-    float *zpos;
+    struct bezier_arena *arena;
+    float *points; // npoints records of BEZIER3D_STRIDE floats
     int npoints;
+    int finalized;
+    int arc_ready;
+    struct bezier_arc arc;
+};
+
+extern struct bezier_arena bezier_default_arena; // of bezier2d_init() and bezier3d_init() curves
+
+#define BEZIER_SAMPLER_MAX_POINTS 16 // longer curves are sampled with Horner's method
+
+/* Forward differencing over t = start + n * step, differences of every order kept in
+ * double so round-off does not build up over many steps */
+struct bezier2d_sampler
+{
+    struct bezier2d *curve;
+    double x[BEZIER_SAMPLER_MAX_POINTS];
+    double y[BEZIER_SAMPLER_MAX_POINTS];
+    double start;
+    double step;
+    long n;
+    int wrap; // t runs modulo 1, for periodic gaits
 };
 
+struct bezier3d_sampler
+{
+    struct bezier3d *curve;
+    double x[BEZIER_SAMPLER_MAX_POINTS];
+    double y[BEZIER_SAMPLER_MAX_POINTS];
+    double z[BEZIER_SAMPLER_MAX_POINTS];
+    double start;
+    double step;
+    long n;
+    int wrap;
+};
+
+void bezier_arc_init(struct bezier_arc *arc, const float *distance, int nsteps);
+float bezier_arc_lookup(const struct bezier_arc *arc, float distance);
+
+void bezier_arena_init(struct bezier_arena *arena, float *storage, int capacity);
+void bezier_arena_reset(struct bezier_arena *arena);
+
 void bezier2d_init(struct bezier2d *curve);
-void bezier2d_addPoint(struct bezier2d *curve, float x, float y);
+void bezier2d_init_arena(struct bezier2d *curve, struct bezier_arena *arena);
+int bezier2d_addPoint(struct bezier2d *curve, float x, float y);
+void bezier2d_finalize(struct bezier2d *curve);
 void bezier2d_getPos(struct bezier2d *curve, float t, float *xret, float *yret);
-void bezier2d_generate_curve(struct bezier2d *curve, float startx, float startz, float controlx,
-                             float controlz, float endx, float endz);
-void bezier2d_generate_straight_back(struct bezier2d *stright_back, float startx, float startz,
-                                     float endx, float endy);
+void bezier2d_getPos_batch(struct bezier2d *curve, const float *t, int count, float *xret,
+                           float *yret);
+void bezier2d_getPos_curves(struct bezier2d *curves, const float *t, int count, float *xret,
+                            float *yret);
+void bezier2d_free(struct bezier2d *curve);
+void bezier2d_sampler_init(struct bezier2d_sampler *sampler, struct bezier2d *curve,
+                           double start, double step, int wrap);
+void bezier2d_sampler_next(struct bezier2d_sampler *sampler, float *xret, float *yret);
+void bezier2d_sample(struct bezier2d *curve, int num_points, float *xret, float *yret);
+float bezier2d_length(struct bezier2d *curve);
+float bezier2d_t_at_distance(struct bezier2d *curve, float distance);
+void bezier2d_getPos_uniform(struct bezier2d *curve, float u, float *xret, float *yret);
+int bezier2d_generate_curve(struct bezier2d *curve, float startx, float startz, float controlx,
+                            float controlz, float endx, float endz);
+int bezier2d_generate_straight_back(struct bezier2d *stright_back, float startx, float startz,
+                                    float endx, float endy);
 
 void bezier3d_init(struct bezier3d *curve);
-void bezier3d_addpoint(struct bezier3d *curve, float x, float y, float z);
+void bezier3d_init_arena(struct bezier3d *curve, struct bezier_arena *arena);
+int bezier3d_addpoint(struct bezier3d *curve, float x, float y, float z);
+void bezier3d_finalize(struct bezier3d *curve);
 void bezier3d_getpos(struct bezier3d *curve, float t, float *xret, float *yret, float *zret);
-void bezier3d_generate_curve(struct bezier3d *curve, float startx, float starty, float startz,
-                             float controlx, float controly, float controlz, float endx, float endy,
-                             float endz);
+void bezier3d_getpos_batch(struct bezier3d *curve, const float *t, int count, float *xret,
+                           float *yret, float *zret);
+void bezier3d_getpos_curves(struct bezier3d *curves, const float *t, int count, float *xret,
+                            float *yret, float *zret);
+void bezier3d_free(struct bezier3d *curve);
+void bezier3d_sampler_init(struct bezier3d_sampler *sampler, struct bezier3d *curve,
+                           double start, double step, int wrap);
+void bezier3d_sampler_next(struct bezier3d_sampler *sampler, float *xret, float *yret,
+                           float *zret);
+void bezier3d_sample(struct bezier3d *curve, int num_points, float *xret, float *yret,
+                     float *zret);
+float bezier3d_length(struct bezier3d *curve);
+float bezier3d_t_at_distance(struct bezier3d *curve, float distance);
+void bezier3d_getpos_uniform(struct bezier3d *curve, float u, float *xret, float *yret,
+                             float *zret);
+int bezier3d_generate_curve(struct bezier3d *curve, float startx, float starty, float startz,
+                            float controlx, float controly, float controlz, float endx, float endy,
+                            float endz);
 
 #endif /*BEZIER_H*/
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include <math.h>
+#include <stdio.h>
+#include "bezier.h"
+
+// forward differencing samplers and arc length lookup of the Bezier curves, run with
+// `make check`
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                            \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+            failures++;                                                                            \
+        }                                                                                          \
+    } while (0)
+
+#define TEST_STEPS 50 // samples per cycle, NUM_POINTS of the gaits
+#define TEST_CYCLES 2000 // wrapped cycles the periodic samplers run
+#define TEST_TOLERANCE 1e-3f // mm, float round-off of a sample against Horner's method
+#define TEST_WRAP_DRIFT 1e-4f // mm a wrapped sampler may drift over TEST_CYCLES
+#define TEST_ARC_SPREAD 0.017f // arc-uniform steps within 1.7% of their mean length
+
+static float storage[64 * BEZIER3D_STRIDE];
+static struct bezier_arena arena;
+
+/**
+ * @brief parameter of sample n of a sampler, the whole cycle a wrapped one restarts at.
+ */
+static double sample_t(double start, double step, long n, int wrap)
+{
+    double t = start + n * step;
+    if (!wrap) {
+        return t;
+    }
+    t -= floor(t);
+    return t > 1.0 - 1e-9 ? 0.0 : t;
+}
+
+/**
+ * @brief a swing shaped like the walk generators' ones, start and end points apart.
+ */
+static void swing_2d(struct bezier2d *curve)
+{
+    bezier2d_init_arena(curve, &arena);
+    bezier2d_addPoint(curve, 150.0f, -120.0f);
+    bezier2d_addPoint(curve, 135.0f, -40.0f);
+    bezier2d_addPoint(curve, 60.0f, -50.0f);
+    bezier2d_addPoint(curve, 50.0f, -120.0f);
+}
+
+static void test_sampler_2d(int wrap, double start, double step, long samples)
+{
+    struct bezier2d curve;
+    struct bezier2d_sampler sampler;
+    float worst = 0.0f;
+
+    bezier_arena_reset(&arena);
+    swing_2d(&curve);
+    bezier2d_sampler_init(&sampler, &curve, start, step, wrap);
+    for (long n = 0; n < samples; n++) {
+        float x, y, rx, ry;
+        bezier2d_sampler_next(&sampler, &x, &y);
+        bezier2d_getPos(&curve, (float)sample_t(start, step, n, wrap), &rx, &ry);
+        worst = fmaxf(worst, fmaxf(fabsf(x - rx), fabsf(y - ry)));
+    }
+    CHECK(worst < (wrap ? TEST_WRAP_DRIFT : TEST_TOLERANCE),
+          "2d sampler wrap %d step %g: %ld samples off by %g", wrap, step, samples, worst);
+}
+
+static void test_sampler_3d(int wrap, double start, double step, long samples)
+{
+    struct bezier3d curve;
+    struct bezier3d_sampler sampler;
+    float worst = 0.0f;
+
+    bezier_arena_reset(&arena);
+    bezier3d_init_arena(&curve, &arena);
+    bezier3d_addpoint(&curve, 150.0f, 20.0f, -120.0f);
+    bezier3d_addpoint(&curve, 135.0f, 40.0f, -40.0f);
+    bezier3d_addpoint(&curve, 60.0f, -10.0f, -50.0f);
+    bezier3d_addpoint(&curve, 50.0f, 0.0f, -120.0f);
+    bezier3d_sampler_init(&sampler, &curve, start, step, wrap);
+    for (long n = 0; n < samples; n++) {
+        float x, y, z, rx, ry, rz;
+        bezier3d_sampler_next(&sampler, &x, &y, &z);
+        bezier3d_getpos(&curve, (float)sample_t(start, step, n, wrap), &rx, &ry, &rz);
+        worst = fmaxf(worst, fmaxf(fabsf(x - rx), fmaxf(fabsf(y - ry), fabsf(z - rz))));
+    }
+    CHECK(worst < (wrap ? TEST_WRAP_DRIFT : TEST_TOLERANCE),
+          "3d sampler wrap %d step %g: %ld samples off by %g", wrap, step, samples, worst);
+}
+
+/**
+ * @brief a step that is not exact in binary lands a hair below 1, which must still wrap.
+ */
+static void test_wrap_tolerance(void)
+{
+    struct bezier2d curve;
+    struct bezier2d_sampler sampler;
+    float x0, y0, x, y;
+
+    bezier_arena_reset(&arena);
+    swing_2d(&curve);
+    bezier2d_getPos(&curve, 0.0f, &x0, &y0);
+    for (int steps = 3; steps <= 100; steps++) {
+        bezier2d_sampler_init(&sampler, &curve, 0.0, 1.0 / steps, 1);
+        for (int cycle = 0; cycle < 3; cycle++) {
+            // every cycle starts again at t = 0 instead of repeating the end point
+            bezier2d_sampler_next(&sampler, &x, &y);
+            CHECK(fabsf(x - x0) < TEST_TOLERANCE && fabsf(y - y0) < TEST_TOLERANCE,
+                  "%d steps, cycle %d: started at (%g, %g), not (%g, %g)", steps, cycle, x, y,
+                  x0, y0);
+            for (int n = 1; n < steps; n++) {
+                bezier2d_sampler_next(&sampler, &x, &y);
+            }
+        }
+    }
+}
+
+/**
+ * @brief bezier2d_getPos_uniform() steps evenly along the curve where t does not.
+ */
+static void test_uniform(void)
+{
+    struct bezier2d curve;
+    float step[TEST_STEPS], t_step[TEST_STEPS];
+    float px, py, tx, ty;
+
+    bezier_arena_reset(&arena);
+    swing_2d(&curve);
+    bezier2d_getPos_uniform(&curve, 0.0f, &px, &py);
+    tx = px;
+    ty = py;
+    float mean = 0.0f, t_mean = 0.0f;
+    for (int i = 1; i <= TEST_STEPS; i++) {
+        float x, y;
+        bezier2d_getPos_uniform(&curve, (float)i / TEST_STEPS, &x, &y);
+        step[i - 1] = hypotf(x - px, y - py);
+        mean += step[i - 1] / TEST_STEPS;
+        px = x;
+        py = y;
+
+        bezier2d_getPos(&curve, (float)i / TEST_STEPS, &x, &y);
+        t_step[i - 1] = hypotf(x - tx, y - ty);
+        t_mean += t_step[i - 1] / TEST_STEPS;
+        tx = x;
+        ty = y;
+    }
+
+    float spread = 0.0f, t_spread = 0.0f;
+    for (int i = 0; i < TEST_STEPS; i++) {
+        spread = fmaxf(spread, fabsf(step[i] - mean) / mean);
+        t_spread = fmaxf(t_spread, fabsf(t_step[i] - t_mean) / t_mean);
+    }
+    CHECK(spread < TEST_ARC_SPREAD, "arc-uniform steps spread %.2f%%", 100.0f * spread);
+    // otherwise the curve would not tell the two apart
+    CHECK(t_spread > 5.0f * TEST_ARC_SPREAD, "t-uniform steps spread only %.2f%%",
+          100.0f * t_spread);
+    CHECK(fabsf(mean * TEST_STEPS - bezier2d_length(&curve)) < 0.01f * bezier2d_length(&curve),
+          "steps add up to %g, length %g", mean * TEST_STEPS, bezier2d_length(&curve));
+
+    float x, y, ex, ey;
+    bezier2d_getPos_uniform(&curve, 1.0f, &x, &y);
+    bezier2d_getPos(&curve, 1.0f, &ex, &ey);
+    CHECK(fabsf(x - ex) < TEST_TOLERANCE && fabsf(y - ey) < TEST_TOLERANCE,
+          "u = 1 at (%g, %g), end point (%g, %g)", x, y, ex, ey);
+}
+
+int main(void)
+{
+    bezier_arena_init(&arena, storage, sizeof(storage) / sizeof(storage[0]));
+
+    test_sampler_2d(0, 0.0, 1.0 / TEST_STEPS, TEST_STEPS + 1);
+    test_sampler_3d(0, 0.0, 1.0 / TEST_STEPS, TEST_STEPS + 1);
+    test_sampler_2d(1, 0.3, 1.0 / TEST_STEPS, (long)TEST_CYCLES * TEST_STEPS);
+    test_sampler_3d(1, 0.3, 1.0 / TEST_STEPS, (long)TEST_CYCLES * TEST_STEPS);
+    test_sampler_2d(1, 0.0, 1.0 / 3, (long)TEST_CYCLES * 3);
+    test_wrap_tolerance();
+    test_uniform();
+
+    printf("%s\n", failures ? "bezier test FAILED" : "bezier test passed");
+    return failures ? 1 : 0;
+}
@@ -1,18 +1,14 @@
 #include "calibrate_servo.h"
 
 void set_zero(void) {
-    set_pwm_angle(SERVO_CHANNEL_1, 0);
-    set_pwm_angle(SERVO_CHANNEL_2, 0);
-    set_pwm_angle(SERVO_CHANNEL_3, 0);
-    set_pwm_angle(SERVO_CHANNEL_4, 0);
-    set_pwm_angle(SERVO_CHANNEL_5, 0);
-    set_pwm_angle(SERVO_CHANNEL_6, 0);
-    set_pwm_angle(SERVO_CHANNEL_7, 0);
-    set_pwm_angle(SERVO_CHANNEL_8, 0);
-    set_pwm_angle(SERVO_CHANNEL_9, 0);
-    set_pwm_angle(SERVO_CHANNEL_10, 0);
-    set_pwm_angle(SERVO_CHANNEL_11, 0);
-    set_pwm_angle(SERVO_CHANNEL_12, 0);
+    // every output off in one ALL_CALL write, nothing left from a previous run keeps driving
+    pwm_all_off();
+
+    // leg servos to 0 degrees, the gripper on channels 13 and 14 stays limp
+    struct pwm_frame frame;
+    pwm_frame_init(&frame);
+    pwm_frame_set_all_angle(&frame, PWM_CHANNEL_MASK(SERVO_CHANNEL_1, SERVO_CHANNEL_12), 0);
+    pwm_frame_commit(&frame);
 }
 
 void set_pwm_angle_manual(uint8_t channel, int pulse_width)
@@ -40,6 +36,9 @@ void calibrate_servo(uint8_t channel)
         printf("Are you satisfied with these values? (y/n): ");
         done = read_char_from_terminal();
     } while (done != 'y' && done != 'Y');
+
+    calibration_data[channel - 1].min_pulse_width = min_pulse_width;
+    calibration_data[channel - 1].max_pulse_width = max_pulse_width;
 }
 
 void adjust_servo(uint8_t channel, int angle)
@@ -79,6 +78,11 @@ int main(void) {
     for (int i = 1; i <= 12; i++) {
         calibrate_servo(i);
     }
+    // main program loads this file into the angle tables at startup
+    if (pwm_calibration_save(PWM_CALIBRATION_FILE, calibration_data, 12) < 0) {
+        return 1;
+    }
+    printf("Calibration saved to %s\n", PWM_CALIBRATION_FILE);
 
     return 0;
 }
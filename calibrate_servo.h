@@ -17,11 +17,7 @@
 #define SERVO_CHANNEL_11 11
 #define SERVO_CHANNEL_12 12
 
-struct CalibrationData
-{
-    int min_pulse_width;
-    int max_pulse_width;
-}calibration_data[12];
+struct CalibrationData calibration_data[12];
 
 void set_zero(void);
 void set_pwm_angle_manual(uint8_t channel, int pulse_width);
@@ -1,14 +1,23 @@
 #include "capit.h"
+#include "servo_output.h"
 
+// lewat servo_output, thread output yang memegang bus selama berjalan
+static void set_capit_angle(uint8_t channel, int angle)
+{
+    struct pwm_frame frame;
+    pwm_frame_init(&frame);
+    pwm_frame_set_angle(&frame, channel, angle);
+    servo_output_submit(&frame);
+}
 
 void set_angle_mg(int angle)
 {
-    set_pwm_angle(CAPIT_BASE, angle);
+    set_capit_angle(CAPIT_BASE, angle);
 }
 
 void set_angle_sg(int angle)
 {
-    set_pwm_angle(CAPIT_UJUNG, angle);
+    set_capit_angle(CAPIT_UJUNG, angle);
 }
 
 void buka_capit(void)
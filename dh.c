@@ -60,3 +60,72 @@ void calculate_DH_transformation(const DHParameters *params_array, int num_links
     // Free the identityMatrix
     gsl_matrix_free(identityMatrix);
 }
+
+/**
+ * @brief precompute the joint independent terms of a link.
+ *
+ * @param link result.
+ * @param params link parameters, theta is ignored.
+ */
+void init_DH_link(DHLink *link, const DHParameters *params)
+{
+    link->cos_alpha = cosf(params->alpha);
+    link->sin_alpha = sinf(params->alpha);
+    link->a = params->a;
+    link->d = params->d;
+}
+
+/**
+ * @brief link transform for a joint angle given by its cosine and sine.
+ */
+void DH_link_matrix(const DHLink *link, float cos_theta, float sin_theta, DHMatrix *matrix)
+{
+    matrix->m[0][0] = cos_theta;
+    matrix->m[0][1] = -sin_theta * link->cos_alpha;
+    matrix->m[0][2] = sin_theta * link->sin_alpha;
+    matrix->m[0][3] = link->a * cos_theta;
+
+    matrix->m[1][0] = sin_theta;
+    matrix->m[1][1] = cos_theta * link->cos_alpha;
+    matrix->m[1][2] = -cos_theta * link->sin_alpha;
+    matrix->m[1][3] = link->a * sin_theta;
+
+    matrix->m[2][0] = 0.0f;
+    matrix->m[2][1] = link->sin_alpha;
+    matrix->m[2][2] = link->cos_alpha;
+    matrix->m[2][3] = link->d;
+}
+
+/**
+ * @brief result = a * b for two homogeneous transforms, result may alias a.
+ */
+void DH_multiply(const DHMatrix *a, const DHMatrix *b, DHMatrix *result)
+{
+    DHMatrix r;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            r.m[i][j] = a->m[i][0] * b->m[0][j] + a->m[i][1] * b->m[1][j] + a->m[i][2] * b->m[2][j];
+        }
+        r.m[i][3] += a->m[i][3];
+    }
+    *result = r;
+}
+
+/**
+ * @brief allocation free counterpart of calculate_DH_transformation().
+ *
+ * @param links precomputed links.
+ * @param theta joint angle of every link.
+ * @param num_links number of links.
+ * @param result base to end transform.
+ */
+void DH_chain(const DHLink *links, const float *theta, int num_links, DHMatrix *result)
+{
+    DHMatrix link_matrix;
+
+    DH_link_matrix(&links[0], cosf(theta[0]), sinf(theta[0]), result);
+    for (int i = 1; i < num_links; i++) {
+        DH_link_matrix(&links[i], cosf(theta[i]), sinf(theta[i]), &link_matrix);
+        DH_multiply(result, &link_matrix, result);
+    }
+}
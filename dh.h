@@ -1,6 +1,7 @@
 #ifndef DH_H
 #define DH_H
 
+#include <math.h>
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_blas.h>
@@ -14,9 +15,29 @@ typedef struct
     float theta;
 } DHParameters;
 
+/* Constant part of a DH link, trig of alpha evaluated once */
+typedef struct
+{
+    float cos_alpha;
+    float sin_alpha;
+    float a;
+    float d;
+} DHLink;
+
+/* Homogeneous transform, the bottom row is always 0 0 0 1 and not stored */
+typedef struct
+{
+    float m[3][4];
+} DHMatrix;
+
 void init_DH_params(DHParameters *params, float alpha, float a, float d, float theta);
 void create_DH_matrix(const DHParameters *params, gsl_matrix *matrix);
 void calculate_DH_transformation(const DHParameters *params_array, int num_links,
                                  gsl_matrix *result);
 
+void init_DH_link(DHLink *link, const DHParameters *params);
+void DH_link_matrix(const DHLink *link, float cos_theta, float sin_theta, DHMatrix *matrix);
+void DH_multiply(const DHMatrix *a, const DHMatrix *b, DHMatrix *result);
+void DH_chain(const DHLink *links, const float *theta, int num_links, DHMatrix *result);
+
 #endif /*DH_H*/
\ No newline at end of file
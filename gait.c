@@ -0,0 +1,351 @@
+#define _DEFAULT_SOURCE
+#include <unistd.h>
+#include "gait.h"
+
+/**
+ * @brief foot targets of a leg at evenly spaced phases of its trajectory.
+ *
+ * @param table gait table.
+ * @param gait_leg leg.
+ * @param traj foot trajectory of the leg.
+ * @param first trajectory phase of the first target.
+ * @param step phase between targets.
+ * @param count number of targets.
+ * @param feet foot x, y, z of every target, out.
+ */
+static void eval_feet(const struct gait_table *table, const struct gait_leg *gait_leg,
+                      const struct trajectory *traj, float first, float step, int count,
+                      float feet[][3])
+{
+    for (int i = 0; i < count; i++) {
+        float phase = first + i * step;
+        if (table->constant_speed) {
+            trajectory_eval_uniform(traj, phase, &feet[i][0], &feet[i][2]);
+        } else {
+            trajectory_eval(traj, phase, &feet[i][0], &feet[i][2]);
+        }
+        feet[i][1] = gait_leg->start[1];
+    }
+}
+
+/**
+ * @brief IK of a run of foot targets, targets out of reach hold the previous pose as the
+ * live IK loop does.
+ *
+ * @param gait_leg leg.
+ * @param feet foot targets.
+ * @param count number of targets, 1..GAIT_MAX_TICKS; nothing is solved outside it.
+ * @param angles servo angles of every target, out.
+ */
+static void solve_feet(const struct gait_leg *gait_leg, const float feet[][3], int count,
+                       float angles[][3])
+{
+    if (count < 1 || count > GAIT_MAX_TICKS) {
+        return;
+    }
+    // sized by count, so every element the IK reads has been written
+    float x[count], y[count], z[count];
+    float theta1[count], theta2[count], theta3[count];
+    enum ik_status status[count];
+    for (int i = 0; i < count; i++) {
+        x[i] = feet[i][0];
+        y[i] = feet[i][1];
+        z[i] = feet[i][2];
+    }
+    inverse_kinematics_batch_leg(gait_leg->position, x, y, z, count, theta1, theta2, theta3,
+                                 status);
+
+    const SpiderLeg *leg = gait_leg->leg;
+    float held[3] = { leg->theta1, leg->theta2, leg->theta3 };
+    for (int i = 0; i < count; i++) {
+        if (status[i] != IK_OUT_OF_WORKSPACE) {
+            held[0] = theta1[i];
+            held[1] = theta2[i];
+            held[2] = theta3[i];
+        }
+        memcpy(angles[i], held, sizeof(held));
+    }
+}
+
+/**
+ * @brief joint angles of a leg at every tick from splines through sparse IK keyframes.
+ *
+ * One spline per joint and trajectory segment, each through about keyframes * its share
+ * of the cycle keyframes, so the corners where the swing and stance meet stay sharp
+ * instead of being rounded off by a spline across them.
+ *
+ * @param table gait table.
+ * @param gait_leg leg.
+ * @param traj foot trajectory of the leg.
+ * @param angles servo angles at every tick, out.
+ */
+static void spline_leg(const struct gait_table *table, const struct gait_leg *gait_leg,
+                       const struct trajectory *traj, float angles[][3])
+{
+    struct joint_spline spline[TRAJECTORY_MAX_SEGMENTS][3];
+    float key_feet[JOINT_SPLINE_MAX_KEYS][3];
+    float key_angles[JOINT_SPLINE_MAX_KEYS][3];
+    float values[JOINT_SPLINE_MAX_KEYS];
+
+    for (int s = 0; s < traj->nsegments; s++) {
+        const struct trajectory_segment *segment = &traj->segments[s];
+        float span = 1.0f / segment->inv_span;
+        int nkeys = (int)lroundf(table->keyframes * span) + 1;
+        if (nkeys < JOINT_SPLINE_MIN_KEYS) {
+            nkeys = JOINT_SPLINE_MIN_KEYS;
+        }
+        if (nkeys > JOINT_SPLINE_MAX_KEYS) {
+            nkeys = JOINT_SPLINE_MAX_KEYS;
+        }
+
+        eval_feet(table, gait_leg, traj, segment->start, span / (nkeys - 1), nkeys, key_feet);
+        solve_feet(gait_leg, key_feet, nkeys, key_angles);
+        for (int k = 0; k < 3; k++) {
+            for (int i = 0; i < nkeys; i++) {
+                values[i] = key_angles[i][k];
+            }
+            joint_spline_fit(&spline[s][k], values, nkeys, segment->start, span);
+        }
+    }
+
+    for (int i = 0; i < table->num_ticks; i++) {
+        float phase = (float)i / (table->num_ticks - 1) + gait_leg->phase_offset;
+        phase -= floorf(phase);
+        int s = traj->nsegments - 1;
+        while (s > 0 && traj->segments[s].start > phase) {
+            s--;
+        }
+        for (int k = 0; k < 3; k++) {
+            angles[i][k] = joint_spline_eval(&spline[s][k], phase);
+        }
+    }
+}
+
+/**
+ * @brief evaluate the trajectory and IK of one leg into its column of the table.
+ *
+ * With table->keyframes set IK only runs at the keyframes and joint splines fill in the
+ * ticks (spline_leg()), so the tick count can grow without adding IK solves.
+ *
+ * @param table gait table.
+ * @param j leg index.
+ */
+static void compile_leg(struct gait_table *table, int j)
+{
+    struct gait_leg *gait_leg = &table->legs[j];
+    SpiderLeg *leg = gait_leg->leg;
+    struct trajectory traj;
+
+    // the trajectory generators start from the foot position in joints[3]
+    SpiderLeg start = *leg;
+    memcpy(start.joints[3], gait_leg->start, sizeof(gait_leg->start));
+    generate_walk_segments(&traj, &start, gait_leg->stride_length, gait_leg->swing_height,
+                           table->duty_factor, gait_leg->position);
+
+    float feet[GAIT_MAX_TICKS][3];
+    float angles[GAIT_MAX_TICKS][3];
+    eval_feet(table, gait_leg, &traj, gait_leg->phase_offset, 1.0f / (table->num_ticks - 1),
+              table->num_ticks, feet);
+    if (table->keyframes > 0) {
+        spline_leg(table, gait_leg, &traj, angles);
+    } else {
+        solve_feet(gait_leg, feet, table->num_ticks, angles);
+    }
+
+    for (int i = 0; i < table->num_ticks; i++) {
+        memcpy(table->feet[i][j], feet[i], sizeof(feet[i]));
+        for (int k = 0; k < 3; k++) {
+            table->angles[i][j][k] = angles[i][k];
+            table->ticks[i][j * 3 + k] = angle_to_ticks(leg->servo_channles[k], angles[i][k]);
+        }
+    }
+
+    gait_leg->dirty = 0;
+}
+
+/**
+ * @brief set up and compile a gait table.
+ *
+ * Every leg walks a swing segment then a stance segment (generate_walk_segments()),
+ * built from the current foot position in joints[3], the stance taking GAIT_DUTY_FACTOR
+ * of the cycle, shifted by its phase offset. IK runs at GAIT_KEYFRAMES keyframes per
+ * cycle, see gait_table_set_keyframes(). Compile after PCA9685_init() and
+ * pwm_lut_build(), the table holds ticks from the channel tables of that moment.
+ *
+ * @param table table to fill.
+ * @param legs legs, their feet must be placed (forward_kinematics()).
+ * @param positions leg positions.
+ * @param phase_offsets cycle fraction every leg runs ahead.
+ * @param stride_length stride of every leg.
+ * @param swing_height swing height of every leg.
+ * @param num_points trajectory points per cycle (table rows - 1).
+ */
+void gait_table_init(struct gait_table *table, SpiderLeg *legs[NUM_LEGS],
+                     const LegPosition positions[NUM_LEGS], const float phase_offsets[NUM_LEGS],
+                     float stride_length, float swing_height, int num_points)
+{
+    table->num_ticks = num_points + 1;
+    if (table->num_ticks > GAIT_MAX_TICKS) {
+        table->num_ticks = GAIT_MAX_TICKS;
+    }
+    table->constant_speed = 0;
+    table->duty_factor = GAIT_DUTY_FACTOR;
+    table->keyframes = GAIT_KEYFRAMES;
+    for (int j = 0; j < NUM_LEGS; j++) {
+        struct gait_leg *gait_leg = &table->legs[j];
+        gait_leg->leg = legs[j];
+        gait_leg->position = positions[j];
+        gait_leg->stride_length = stride_length;
+        gait_leg->swing_height = swing_height;
+        gait_leg->phase_offset = phase_offsets[j];
+        memcpy(gait_leg->start, legs[j]->joints[3], sizeof(gait_leg->start));
+        gait_leg->dirty = 1;
+    }
+    gait_table_update(table);
+}
+
+/**
+ * @brief change the stride of one leg, recompiled by the next gait_table_update().
+ *
+ * @param table gait table.
+ * @param leg leg index.
+ * @param stride_length new stride.
+ * @param swing_height new swing height.
+ */
+void gait_table_set_leg(struct gait_table *table, int leg, float stride_length, float swing_height)
+{
+    struct gait_leg *gait_leg = &table->legs[leg];
+    if (gait_leg->stride_length != stride_length || gait_leg->swing_height != swing_height) {
+        gait_leg->stride_length = stride_length;
+        gait_leg->swing_height = swing_height;
+        gait_leg->dirty = 1;
+    }
+}
+
+/**
+ * @brief change the stride of every leg.
+ */
+void gait_table_set_stride(struct gait_table *table, float stride_length, float swing_height)
+{
+    for (int j = 0; j < NUM_LEGS; j++) {
+        gait_table_set_leg(table, j, stride_length, swing_height);
+    }
+}
+
+/**
+ * @brief space the ticks evenly along the foot path, so the foot moves at constant speed.
+ *
+ * Within each of the swing and stance segments; they keep their share of the cycle.
+ * Takes effect at the next gait_table_update().
+ *
+ * @param table gait table.
+ * @param constant_speed non-zero for constant speed, zero to step the curve parameter.
+ */
+void gait_table_set_constant_speed(struct gait_table *table, int constant_speed)
+{
+    if (table->constant_speed == constant_speed) {
+        return;
+    }
+    table->constant_speed = constant_speed;
+    for (int j = 0; j < NUM_LEGS; j++) {
+        table->legs[j].dirty = 1;
+    }
+}
+
+/**
+ * @brief set the fraction of the cycle every foot is on the ground.
+ *
+ * Takes effect at the next gait_table_update().
+ *
+ * @param table gait table.
+ * @param duty_factor stance share of the cycle, in (0, 1).
+ */
+void gait_table_set_duty_factor(struct gait_table *table, float duty_factor)
+{
+    table->duty_factor = duty_factor;
+    for (int j = 0; j < NUM_LEGS; j++) {
+        table->legs[j].dirty = 1;
+    }
+}
+
+/**
+ * @brief set the keyframes per cycle IK runs at, joint splines fill in the other ticks.
+ *
+ * Takes effect at the next gait_table_update().
+ *
+ * @param table gait table.
+ * @param keyframes keyframe intervals per cycle, at most JOINT_SPLINE_MAX_KEYS - 1;
+ *        0 to solve IK at every tick.
+ */
+void gait_table_set_keyframes(struct gait_table *table, int keyframes)
+{
+    if (keyframes < 0) {
+        keyframes = 0;
+    }
+    if (keyframes > JOINT_SPLINE_MAX_KEYS - 1) {
+        keyframes = JOINT_SPLINE_MAX_KEYS - 1;
+    }
+    table->keyframes = keyframes;
+    for (int j = 0; j < NUM_LEGS; j++) {
+        table->legs[j].dirty = 1;
+    }
+}
+
+/**
+ * @brief recompile the columns of legs whose parameters changed.
+ *
+ * @param table gait table.
+ * @return number of legs recompiled.
+ */
+int gait_table_update(struct gait_table *table)
+{
+    int compiled = 0;
+    for (int j = 0; j < NUM_LEGS; j++) {
+        if (table->legs[j].dirty) {
+            compile_leg(table, j);
+            compiled++;
+        }
+    }
+    return compiled;
+}
+
+/**
+ * @brief replay one gait cycle.
+ *
+ * Every tick is one frame straight from the table. Paced by the output thread when it
+ * runs, otherwise by sleeping cycle_time spread over the ticks.
+ *
+ * @param table compiled gait table.
+ * @param cycle_time duration of the cycle in seconds without the output thread.
+ */
+void gait_table_play(const struct gait_table *table, float cycle_time)
+{
+    float dt = cycle_time / (table->num_ticks - 1);
+
+    for (int i = 0; i < table->num_ticks; i++) {
+        struct pwm_frame frame;
+        pwm_frame_init(&frame);
+        for (int j = 0; j < NUM_LEGS; j++) {
+            const int *channels = table->legs[j].leg->servo_channles;
+            for (int k = 0; k < 3; k++) {
+                pwm_frame_set(&frame, channels[k], 0, table->ticks[i][j * 3 + k]);
+            }
+        }
+        servo_output_submit(&frame);
+
+        if (!servo_output_is_running()) {
+            usleep((long)(dt * 1e6));
+        }
+    }
+
+    // leave the legs in the state of the last tick, like the IK loop does
+    const int last = table->num_ticks - 1;
+    for (int j = 0; j < NUM_LEGS; j++) {
+        SpiderLeg *leg = table->legs[j].leg;
+        leg->theta1 = table->angles[last][j][0];
+        leg->theta2 = table->angles[last][j][1];
+        leg->theta3 = table->angles[last][j][2];
+        forward_kinematics_position(table->angles[last][j], table->legs[j].position,
+                                    leg->joints[3]);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef GAIT_H
+#define GAIT_H
+
+#include <stdint.h>
+#include "ik.h"
+#include "joint_spline.h"
+#include "servo_output.h"
+#include "trajectory.h"
+
+#define GAIT_MAX_TICKS 256 // rows of a gait table, one per trajectory point
+#define GAIT_DUTY_FACTOR 0.5 // stance share of the cycle, trot
+#define GAIT_KEYFRAMES 16 // IK solves per cycle, joint splines fill the ticks in between
+
+/* Per-leg inputs of a compiled gait */
+struct gait_leg
+{
+    SpiderLeg *leg;
+    LegPosition position;
+    float stride_length;
+    float swing_height;
+    float phase_offset; // fraction of a cycle the leg runs ahead
+    float start[3]; // foot position the trajectory is built from
+    int dirty; // parameters changed since the leg's column was compiled
+};
+
+/* A gait cycle evaluated into joint ticks, replayed without curves or IK */
+struct gait_table
+{
+    int num_ticks;
+    int constant_speed; // ticks evenly spaced along the foot path instead of in t
+    float duty_factor; // stance share of the cycle
+    int keyframes; // keyframe intervals per cycle IK runs at, 0 solves every tick
+    struct gait_leg legs[NUM_LEGS];
+    uint16_t ticks[GAIT_MAX_TICKS][NUM_LEGS * 3]; // OFF ticks, row per tick, 3 joints per leg
+    float angles[GAIT_MAX_TICKS][NUM_LEGS][3]; // servo angles behind ticks
+    float feet[GAIT_MAX_TICKS][NUM_LEGS][3]; // foot targets behind angles
+};
+
+void gait_table_init(struct gait_table *table, SpiderLeg *legs[NUM_LEGS],
+                     const LegPosition positions[NUM_LEGS], const float phase_offsets[NUM_LEGS],
+                     float stride_length, float swing_height, int num_points);
+void gait_table_set_leg(struct gait_table *table, int leg, float stride_length, float swing_height);
+void gait_table_set_stride(struct gait_table *table, float stride_length, float swing_height);
+void gait_table_set_duty_factor(struct gait_table *table, float duty_factor);
+void gait_table_set_constant_speed(struct gait_table *table, int constant_speed);
+void gait_table_set_keyframes(struct gait_table *table, int keyframes);
+int gait_table_update(struct gait_table *table);
+void gait_table_play(const struct gait_table *table, float cycle_time);
+
+#endif // GAIT_H
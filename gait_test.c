@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "gait.h"
+#include "pca9685_sim.h"
+
+// foot trajectory lookup and gait table recompiles against the simulated PCA9685, run
+// with `make check`
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                            \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+            failures++;                                                                            \
+        }                                                                                          \
+    } while (0)
+
+#define TEST_PHASES 4000 // phases looked up per trajectory
+#define TEST_POINTS 50 // trajectory points per gait cycle
+#define TEST_STRIDE 60.0f
+#define TEST_SWING 40.0f
+#define TEST_TOLERANCE 1e-4f // mm, float round-off of a foot position
+#define TEST_IK_TOLERANCE 0.1f // mm, foot of the table angles against its target
+
+/**
+ * @brief trajectory_eval() by a linear search over the segments, reference for the lookup.
+ */
+static void eval_linear(const struct trajectory *traj, float phase, float *x, float *z)
+{
+    phase -= floorf(phase);
+    int s = 0;
+    while (s + 1 < traj->nsegments && traj->segments[s + 1].start <= phase) {
+        s++;
+    }
+    const struct trajectory_segment *segment = &traj->segments[s];
+    float u = fminf((phase - segment->start) * segment->inv_span, 1.0f);
+    *x = segment->xcoef[0] + u * (segment->xcoef[1] + u * segment->xcoef[2]);
+    *z = segment->zcoef[0] + u * (segment->zcoef[1] + u * segment->zcoef[2]);
+}
+
+/**
+ * @brief the phase buckets find the right segment, also for segments shorter than a
+ * bucket and for phases outside [0, 1).
+ */
+static void test_trajectory_find(void)
+{
+    // shares of the cycle, two of them shorter than a 1 / TRAJECTORY_LOOKUP bucket
+    const float durations[] = { 0.02f, 1.0f, 0.5f, 0.01f, 0.015f, 2.0f };
+    const int nsegments = sizeof(durations) / sizeof(durations[0]);
+    struct trajectory traj;
+
+    trajectory_init(&traj);
+    for (int s = 0; s < nsegments; s++) {
+        float x[3] = { 10.0f * s, 10.0f * s + 5.0f, 10.0f * (s + 1) };
+        float z[3] = { -100.0f, -100.0f + 20.0f * (s % 2), -100.0f };
+        CHECK(trajectory_add_segment(&traj, x, z, durations[s]) == 0, "segment %d not added", s);
+    }
+    trajectory_finalize(&traj);
+
+    float worst = 0.0f;
+    for (int n = -TEST_PHASES; n <= 2 * TEST_PHASES; n++) {
+        float phase = (float)n / TEST_PHASES;
+        float x, z, rx, rz;
+        trajectory_eval(&traj, phase, &x, &z);
+        eval_linear(&traj, phase, &rx, &rz);
+        worst = fmaxf(worst, fmaxf(fabsf(x - rx), fabsf(z - rz)));
+    }
+    CHECK(worst < TEST_TOLERANCE, "bucket lookup off the linear search by %g", worst);
+
+    // right at and just before every segment start
+    for (int s = 1; s < nsegments; s++) {
+        float start = traj.segments[s].start;
+        float x, z;
+        trajectory_eval(&traj, start, &x, &z);
+        CHECK(fabsf(x - 10.0f * s) < TEST_TOLERANCE, "segment %d start at x %g", s, x);
+        trajectory_eval(&traj, nextafterf(start, 0.0f), &x, &z);
+        CHECK(fabsf(x - 10.0f * s) < 1e-2f, "segment %d end at x %g", s - 1, x);
+    }
+}
+
+/**
+ * @brief largest difference between the columns of a leg in two tables.
+ */
+static float column_diff(const struct gait_table *a, const struct gait_table *b, int j)
+{
+    float diff = 0.0f;
+    for (int i = 0; i < a->num_ticks; i++) {
+        for (int k = 0; k < 3; k++) {
+            diff = fmaxf(diff, fabsf(a->angles[i][j][k] - b->angles[i][j][k]));
+            diff = fmaxf(diff, fabsf(a->feet[i][j][k] - b->feet[i][j][k]));
+            diff = fmaxf(diff, abs(a->ticks[i][j * 3 + k] - b->ticks[i][j * 3 + k]));
+        }
+    }
+    return diff;
+}
+
+/**
+ * @brief every tick is the channel table entry of its angle, the cycle is closed.
+ */
+static void check_table(const struct gait_table *table, const char *what)
+{
+    for (int j = 0; j < NUM_LEGS; j++) {
+        const int *channels = table->legs[j].leg->servo_channles;
+        int wrong = 0;
+        for (int i = 0; i < table->num_ticks; i++) {
+            for (int k = 0; k < 3; k++) {
+                wrong += table->ticks[i][j * 3 + k]
+                    != angle_to_ticks(channels[k], table->angles[i][j][k]);
+            }
+        }
+        CHECK(wrong == 0, "%s leg %d: %d ticks not from their angles", what, j, wrong);
+
+        const int last = table->num_ticks - 1;
+        float gap = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            gap = fmaxf(gap, fabsf(table->feet[0][j][k] - table->feet[last][j][k]));
+        }
+        CHECK(gap < 1e-3f, "%s leg %d: cycle ends %g mm from its start", what, j, gap);
+    }
+}
+
+/**
+ * @brief gait_table_update() recompiles exactly the legs whose parameters changed.
+ */
+static void test_gait_table_update(void)
+{
+    static struct gait_table table, before;
+    const float phase_offsets[NUM_LEGS] = { 0.0f, 0.5f, 0.0f, 0.5f };
+
+    gait_table_init(&table, legs, leg_positions, phase_offsets, TEST_STRIDE, TEST_SWING,
+                    TEST_POINTS);
+    CHECK(table.num_ticks == TEST_POINTS + 1, "%d ticks", table.num_ticks);
+    check_table(&table, "init");
+    CHECK(gait_table_update(&table) == 0, "clean table recompiled");
+
+    // one leg: only its column changes
+    before = table;
+    gait_table_set_leg(&table, 1, TEST_STRIDE + 10.0f, TEST_SWING);
+    CHECK(gait_table_update(&table) == 1, "one changed leg not compiled alone");
+    for (int j = 0; j < NUM_LEGS; j++) {
+        float diff = column_diff(&table, &before, j);
+        CHECK(j == 1 ? diff > 1.0f : diff == 0.0f, "leg %d column changed by %g", j, diff);
+    }
+    check_table(&table, "one leg");
+    gait_table_set_leg(&table, 1, TEST_STRIDE + 10.0f, TEST_SWING);
+    CHECK(gait_table_update(&table) == 0, "unchanged stride marked the leg dirty");
+
+    // the stride of every leg, leg 1 already has it
+    gait_table_set_stride(&table, TEST_STRIDE + 10.0f, TEST_SWING);
+    CHECK(gait_table_update(&table) == NUM_LEGS - 1, "stride change recompiled the wrong legs");
+
+    // table wide settings recompile every leg, once
+    gait_table_set_constant_speed(&table, 1);
+    CHECK(gait_table_update(&table) == NUM_LEGS, "constant speed not applied to every leg");
+    gait_table_set_constant_speed(&table, 1);
+    CHECK(gait_table_update(&table) == 0, "same constant speed recompiled");
+    gait_table_set_duty_factor(&table, 0.6f);
+    CHECK(gait_table_update(&table) == NUM_LEGS, "duty factor not applied to every leg");
+
+    // IK at every tick: the angles put each foot on its target
+    gait_table_set_keyframes(&table, 0);
+    CHECK(gait_table_update(&table) == NUM_LEGS, "keyframes not applied to every leg");
+    check_table(&table, "every tick");
+    float worst = 0.0f;
+    for (int i = 0; i < table.num_ticks; i++) {
+        for (int j = 0; j < NUM_LEGS; j++) {
+            float position[3];
+            forward_kinematics_position(table.angles[i][j], table.legs[j].position, position);
+            for (int k = 0; k < 3; k++) {
+                worst = fmaxf(worst, fabsf(position[k] - table.feet[i][j][k]));
+            }
+        }
+    }
+    CHECK(worst < TEST_IK_TOLERANCE, "table angles miss their feet by %g mm", worst);
+}
+
+int main(void)
+{
+    struct pca9685_sim_bus *bus = pca9685_sim_get_bus();
+    pca9685_sim_add_chip(bus, 0x40);
+    pwm_set_transport(&pca9685_sim_transport);
+    PCA9685_init();
+
+    // the legs stand in the stance the robot starts from
+    initialize_all_legs();
+    for (int j = 0; j < NUM_LEGS; j++) {
+        forward_kinematics_position(stance_angles[j], leg_positions[j], legs[j]->joints[3]);
+    }
+
+    test_trajectory_find();
+    test_gait_table_update();
+
+    PCA9685_close();
+    printf("%s\n", failures ? "gait test FAILED" : "gait test passed");
+    return failures ? 1 : 0;
+}
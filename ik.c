@@ -1,3 +1,4 @@
+#define _DEFAULT_SOURCE
 #include "ik.h"
 
 float degrees(float rad)
@@ -32,18 +33,6 @@ float *get_target(SpiderLeg *leg)
     return leg->joints[3];
 }
 
-void set_angles(SpiderLeg *leg, float angles[3])
-{
-    leg->theta1 = normalize_angle(angles[0]);
-    leg->theta2 = normalize_angle(angles[1]);
-    leg->theta3 = normalize_angle(angles[2]);
-
-    for (int i = 0; i < 3; i++) {
-        set_pwm_angle(leg->servo_channles[i], (int)angles[i]);
-        printf("theta%d: %.2f degrees\n", i + 1, angles[i]);
-    }
-}
-
 // Helper function to check if two sets of angles are approximately equal
 int angles_equal(const float angles1[3], const float angles2[3])
 {
@@ -55,40 +44,164 @@ int angles_equal(const float angles1[3], const float angles2[3])
     return 1;
 }
 
-void move_to_angle(SpiderLeg *leg, float target_angles[3], int speed)
+#define DH_DEG(deg) ((float)((deg) * M_PI / 180.0))
+
+// alpha, a and d of the DH links of a leg, theta comes from the servo angles
+static const DHParameters leg_dh_params[NUM_LINKS] = {
+    { DH_DEG(90.0), COXA_LENGTH, 0.0f, 0.0f },
+    { DH_DEG(0.0), FEMUR_LENGTH, 0.0f, 0.0f },
+    { DH_DEG(-90.0), TIBIA_LENGTH, 0.0f, 0.0f },
+    { DH_DEG(90.0), 0.0f, 0.0f, 0.0f },
+};
+
+/**
+ * @brief the links of leg_dh_params with their trig precomputed, built on first use.
+ *
+ * Not thread safe on the very first call.
+ */
+static const DHLink *leg_dh_links(void)
 {
-    float current_angles[3] = { leg->theta1, leg->theta2, leg->theta3 };
-
-    // hitung max change dalam angle per step berdasarkan speed
-    float delta_theta = DELTA_THETA_MAX * (float)speed / 1.0;
+    static DHLink links[NUM_LINKS];
+    static int ready;
 
-    float delta_directions[3];
-    for (int i = 0; i < 3; i++) {
-        delta_directions[i] = (target_angles[i] > current_angles[i]) ? 1.0 : -1.0;
+    if (!ready) {
+        for (int i = 0; i < NUM_LINKS; i++) {
+            init_DH_link(&links[i], &leg_dh_params[i]);
+        }
+        ready = 1;
     }
+    return links;
+}
 
-    // adjust angle gradually toward the target
-    while (!angles_equal(current_angles, target_angles)) {
-        for (int i = 0; i < 3; i++) {
-            // hitung next angle berdasarkan current_angles dan delta_theta
-            float next_angle = current_angles[i] + delta_theta * delta_directions[i];
+#define LEG_ZERO_OFFSET(position, zero_offset, orientation) [position] = zero_offset,
 
-            // make sure the next angle nggk overshoot dari target angles
-            if ((delta_directions[i] > 0 && next_angle > target_angles[i])
-                || (delta_directions[i] < 0 && next_angle < target_angles[i])) {
-                next_angle = target_angles[i];
-            }
+// coxa zero offset of every LegPosition, for the DH and GSL paths
+static const float leg_zero_offset[NUM_LEGS] = { LEG_GEOMETRY(LEG_ZERO_OFFSET) };
 
-            current_angles[i] = next_angle;
-        }
+/**
+ * @brief DH joint angles of a leg from its servo angles.
+ *
+ * @param angles servo angles in degrees.
+ * @param position_leg leg position.
+ * @param theta joint angles of the NUM_LINKS links in radians.
+ */
+static void leg_dh_theta(const float angles[3], LegPosition position_leg, float theta[NUM_LINKS])
+{
+    // -90 on femur and tibia because of the angle offset of mounting the servo
+    theta[0] = radians(angles[0] + leg_zero_offset[position_leg] + 90.0);
+    theta[1] = radians(angles[1] - 90.0);
+    theta[2] = -radians(angles[2]);
+    theta[3] = radians(-90.0);
+}
 
-        // set servo angle dan kasih delay
-        set_angles(leg, current_angles);
-        usleep(DELAY_US);
+/* Sines and cosines of the DH joint angles of a leg pose */
+struct leg_trig
+{
+    float c0, s0; // coxa
+    float c1, s1; // femur
+    float c12, s12; // femur + tibia
+};
+
+/**
+ * @brief trig of the DH joint angles for a coxa offset known at compile time.
+ *
+ * The fixed parts of the joint angles are folded in with the angle sum formulas:
+ * theta0 = a0 + zero_offset + 90 takes the cosine and sine of the constant offset,
+ * theta1 = a1 - 90 and theta1 + theta2 = a1 - a2 - 90 swap sine and cosine. Only the
+ * servo angles need trig at run time.
+ *
+ * @param angles servo angles in degrees.
+ * @param offset_cos cosine of zero_offset + 90.
+ * @param offset_sin sine of zero_offset + 90.
+ * @param trig sines and cosines, out.
+ */
+static inline void leg_trig_kernel(const float angles[3], float offset_cos, float offset_sin,
+                                   struct leg_trig *trig)
+{
+    const float k = M_PI / 180.0f;
+    float a0 = angles[0] * k;
+    float a1 = angles[1] * k;
+    float a12 = (angles[1] - angles[2]) * k; // tibia servo runs against theta2
+
+    float c = cosf(a0), s = sinf(a0);
+    trig->c0 = c * offset_cos - s * offset_sin;
+    trig->s0 = s * offset_cos + c * offset_sin;
+    trig->c1 = sinf(a1);
+    trig->s1 = -cosf(a1);
+    trig->c12 = sinf(a12);
+    trig->s12 = -cosf(a12);
+}
+
+// one trig kernel per leg, the offset trig is a constant expression folded by the compiler
+#define LEG_TRIG_KERNEL(position, zero_offset, orientation)                                       \
+    static void leg_trig_##position(const float angles[3], struct leg_trig *trig)                 \
+    {                                                                                              \
+        leg_trig_kernel(angles, cosf(((zero_offset) + 90.0f) * (float)(M_PI / 180.0)),            \
+                        sinf(((zero_offset) + 90.0f) * (float)(M_PI / 180.0)), trig);             \
     }
+LEG_GEOMETRY(LEG_TRIG_KERNEL)
+
+#define LEG_TRIG_ENTRY(position, zero_offset, orientation) [position] = leg_trig_##position,
+
+// selected once per leg and pose, no branch on the leg inside the kernels
+static void (*const leg_trig[NUM_LEGS])(const float angles[3], struct leg_trig *trig) = {
+    LEG_GEOMETRY(LEG_TRIG_ENTRY)
+};
+
+/**
+ * @brief foot position of a leg, closed form of the DH chain.
+ *
+ * The coxa turns the leg plane about z, femur and tibia are a planar two link arm in
+ * it and the last link only rotates the frame, so the position needs three sine and
+ * cosine pairs and no matrices. Same result as forward_kinematics_gsl().
+ *
+ * @param angles servo angles in degrees.
+ * @param position_leg leg position.
+ * @param position foot position x, y, z (x and y as magnitudes).
+ */
+void forward_kinematics_position(const float angles[3], LegPosition position_leg,
+                                 float position[3])
+{
+    struct leg_trig trig;
+    leg_trig[position_leg](angles, &trig);
+
+    // reach in the leg plane and height of the foot
+    float reach = COXA_LENGTH + FEMUR_LENGTH * trig.c1 + TIBIA_LENGTH * trig.c12;
+    float height = FEMUR_LENGTH * trig.s1 + TIBIA_LENGTH * trig.s12;
+
+    position[0] = fabsf(reach * trig.c0);
+    position[1] = fabsf(reach * trig.s0);
+    position[2] = height;
 }
 
-void forward_kinematics(SpiderLeg *leg, float angles[3], LegPosition position_leg)
+/**
+ * @brief foot position of a leg through the stack allocated DH chain.
+ *
+ * @param angles servo angles in degrees.
+ * @param position_leg leg position.
+ * @param position foot position x, y, z (x and y as magnitudes).
+ */
+void forward_kinematics_dh(const float angles[3], LegPosition position_leg, float position[3])
+{
+    float theta[NUM_LINKS];
+    DHMatrix trans_matrix;
+
+    leg_dh_theta(angles, position_leg, theta);
+    DH_chain(leg_dh_links(), theta, NUM_LINKS, &trans_matrix);
+
+    position[0] = fabsf(trans_matrix.m[0][3]);
+    position[1] = fabsf(trans_matrix.m[1][3]);
+    position[2] = trans_matrix.m[2][3];
+}
+
+/**
+ * @brief foot position of a leg through GSL matrices, reference for the fast paths.
+ *
+ * @param angles servo angles in degrees.
+ * @param position_leg leg position.
+ * @param position foot position x, y, z (x and y as magnitudes).
+ */
+void forward_kinematics_gsl(const float angles[3], LegPosition position_leg, float position[3])
 {
     // Convert to radians
     float theta1 = radians(angles[0]);
@@ -97,43 +210,29 @@ void forward_kinematics(SpiderLeg *leg, float angles[3], LegPosition position_le
     float theta3 =
         -radians(angles[2]) + radians(90); // -90 because of angle offset of mounting_servo
 
-    float zero_offset = 0.0;
-    switch (position_leg) {
-    case KANAN_DEPAN:
-        zero_offset = 0.0;
-        break;
-    case KIRI_DEPAN:
-        zero_offset = 90.0;
-        break;
-    case KIRI_BELAKANG:
-        zero_offset = 180.0;
-        break;
-    case KANAN_BELAKANG:
-        zero_offset = 90.0;
-    default:
-        break;
-    }
-    theta1 += radians(zero_offset);
+    theta1 += radians(leg_zero_offset[position_leg]);
 
+    const DHParameters *p = leg_dh_params;
     DHParameters params_array[NUM_LINKS];
-    init_DH_params(&params_array[0], radians(90.0), COXA_LENGTH, 0.0, (theta1 + radians(90.0)));
-    init_DH_params(&params_array[1], radians(0.0), FEMUR_LENGTH, 0.0, theta2);
-    init_DH_params(&params_array[2], radians(-90.0), TIBIA_LENGTH, 0.0, (theta3 - radians(90.0)));
-    init_DH_params(&params_array[3], radians(90.0), 0.0, 0.0, radians(-90.0));
+    init_DH_params(&params_array[0], p[0].alpha, p[0].a, p[0].d, (theta1 + radians(90.0)));
+    init_DH_params(&params_array[1], p[1].alpha, p[1].a, p[1].d, theta2);
+    init_DH_params(&params_array[2], p[2].alpha, p[2].a, p[2].d, (theta3 - radians(90.0)));
+    init_DH_params(&params_array[3], p[3].alpha, p[3].a, p[3].d, radians(-90.0));
 
     gsl_matrix *trans_matrix = gsl_matrix_alloc(4, 4);
     calculate_DH_transformation(params_array, NUM_LINKS, trans_matrix);
 
-    float x = fabs(gsl_matrix_get(trans_matrix, 0, 3));
+    position[0] = fabs(gsl_matrix_get(trans_matrix, 0, 3));
+    position[1] = fabs(gsl_matrix_get(trans_matrix, 1, 3));
+    position[2] = gsl_matrix_get(trans_matrix, 2, 3);
 
-    float y = gsl_matrix_get(trans_matrix, 1, 3);
-
-    if (y < 0) {
-        y = -y;
-    }
-    float z = gsl_matrix_get(trans_matrix, 2, 3);
+    gsl_matrix_free(trans_matrix);
+}
 
-    const float position[3] = { x, y, z };
+void forward_kinematics(SpiderLeg *leg, float angles[3], LegPosition position_leg)
+{
+    float position[3];
+    forward_kinematics_position(angles, position_leg, position);
 
     // Update leg joints end-effector
     for (int i = 0; i < 3; i++) {
@@ -142,59 +241,352 @@ void forward_kinematics(SpiderLeg *leg, float angles[3], LegPosition position_le
 
     printf("end-effector position: x = %.2f, y = %.2f, z = %.2f\n", leg->joints[3][0],
            leg->joints[3][1], leg->joints[3][2]);
-
-    gsl_matrix_free(trans_matrix);
 }
 
-void inverse_kinematics(SpiderLeg *leg, const float target_positions[3], LegPosition position_leg)
-{
-    float x = target_positions[0];
-    float y = target_positions[1];
-    float z = target_positions[2];
-
-    // adjust_coordinate(x, y, z, position_leg, &x, &y, &z);
-    // angle antara coxa dengan horizontal plane
-    float theta1 = atan2(x, y);
 
-    float P = sqrt(pow(x, 2) + powf(y, 2)) - COXA_LENGTH;
 
-    float G = sqrt(pow(z, 2) + pow(P, 2));
+/**
+ * @brief normalize_angle() without branches, for the batch kernel.
+ */
+static inline float fold_angle(float angle)
+{
+    angle = fmodf(angle, 360.0f);
+    angle += angle < 0.0f ? 360.0f : 0.0f;
+    return angle > 180.0f ? 360.0f - angle : angle;
+}
 
-    float alpha = atan2(z, P);
+/**
+ * @brief analytic IK of one target, shared by ik_solve() and the batch kernel.
+ *
+ * Straight-line float math so it vectorises when inlined into a loop. The knee always
+ * bends up (theta3 = 180 - beta), so the femur sits gamma above the line to the foot.
+ * Targets the leg cannot span are solved with the law of cosines clamped, which points
+ * the leg at the target at full stretch (or full fold); a femur angle past the servo
+ * range is clamped to 0 or 180. Either way the status says how far the foot of the
+ * returned pose lands from the target.
+ *
+ * @param orientation orientation offset of the leg in degrees, a constant in the per leg
+ *        kernels.
+ * @return reachability of the target.
+ */
+static inline enum ik_status ik_solve_one(float x, float y, float z, float orientation,
+                                          float *theta1, float *theta2, float *theta3)
+{
+    const float femur_sq = FEMUR_LENGTH * FEMUR_LENGTH;
+    const float tibia_sq = TIBIA_LENGTH * TIBIA_LENGTH;
+    const float to_deg = 180.0f / M_PI;
+
+    // P: horizontal reach past the coxa, G: femur joint to foot
+    float P = sqrtf(x * x + y * y) - COXA_LENGTH;
+    float G_sq = z * z + P * P;
+    float G = sqrtf(G_sq);
+    float alpha = atan2f(z, P);
+
+    // fminf/fmaxf also turn the NaN of G == 0 into a bound
+    float gamma_cos = (femur_sq + G_sq - tibia_sq) / (2.0f * FEMUR_LENGTH * G);
+    float beta_cos = (femur_sq + tibia_sq - G_sq) / (2.0f * FEMUR_LENGTH * TIBIA_LENGTH);
+    float gamma = acosf(fmaxf(-1.0f, fminf(1.0f, gamma_cos)));
+    float beta = acosf(fmaxf(-1.0f, fminf(1.0f, beta_cos)));
+
+    float t1 = fold_angle(atan2f(x, y) * to_deg + orientation);
+    *theta1 = t1 > 90.0f ? 180.0f - t1 : t1;
+    float t2 = 90.0f + (alpha + gamma) * to_deg; // femur horizontal at 90
+    *theta2 = fmaxf(0.0f, fminf(180.0f, t2));
+    *theta3 = 180.0f - beta * to_deg;
+
+    // distance by which G misses the annulus femur and tibia can span
+    float span_min = fabs(TIBIA_LENGTH - FEMUR_LENGTH);
+    float miss = fmaxf(G - (FEMUR_LENGTH + TIBIA_LENGTH), span_min - G);
+    // chord the foot swings through when the femur is clamped, radius G
+    float swing = 2.0f * G * sinf(fabsf(t2 - *theta2) * (0.5f / to_deg));
+    float outside = fmaxf(miss, 0.0f);
+    float excess = swing > 0.0f ? sqrtf(outside * outside + swing * swing) : miss;
+    return excess <= 0.0f ? IK_REACHABLE : excess <= IK_CLAMP_MARGIN ? IK_CLAMPED
+                                                                        : IK_OUT_OF_WORKSPACE;
+}
 
-    float gamma_cos =
-        (pow(FEMUR_LENGTH, 2) + pow(G, 2) - pow(TIBIA_LENGTH, 2)) / (2 * FEMUR_LENGTH * G);
-    float gamma = acos(gamma_cos);
+// one batch kernel per leg with its orientation offset as a constant
+#define IK_BATCH_KERNEL(position, zero_offset, orientation)                                       \
+    static void ik_batch_##position(const float *restrict x, const float *restrict y,             \
+                                    const float *restrict z, int count, float *restrict theta1,    \
+                                    float *restrict theta2, float *restrict theta3,                \
+                                    enum ik_status *restrict status)                               \
+    {                                                                                              \
+        if (status) {                                                                              \
+            for (int i = 0; i < count; i++) {                                                      \
+                status[i] = ik_solve_one(x[i], y[i], z[i], (orientation), &theta1[i], &theta2[i],  \
+                                         &theta3[i]);                                              \
+            }                                                                                      \
+        } else {                                                                                   \
+            for (int i = 0; i < count; i++) {                                                      \
+                ik_solve_one(x[i], y[i], z[i], (orientation), &theta1[i], &theta2[i], &theta3[i]); \
+            }                                                                                      \
+        }                                                                                          \
+    }
+LEG_GEOMETRY(IK_BATCH_KERNEL)
+
+#define IK_BATCH_ENTRY(position, zero_offset, orientation) [position] = ik_batch_##position,
+
+static void (*const ik_batch[NUM_LEGS])(const float *restrict x, const float *restrict y,
+                                        const float *restrict z, int count,
+                                        float *restrict theta1, float *restrict theta2,
+                                        float *restrict theta3,
+                                        enum ik_status *restrict status) = {
+    LEG_GEOMETRY(IK_BATCH_ENTRY)
+};
+
+/**
+ * @brief solve the joint angles of one foot target.
+ *
+ * No side effects: nothing is written to the servos or the leg and nothing is printed.
+ * Apply the result with ik_apply() and check it with ik_verify() where wanted.
+ *
+ * @param target foot position x, y, z.
+ * @param position_leg leg position, selects the orientation offset.
+ * @param angles servo angles in degrees, out; finite for every status.
+ * @return IK_REACHABLE, IK_CLAMPED when the target was up to IK_CLAMP_MARGIN outside
+ *         the workspace and the nearest pose was used, IK_OUT_OF_WORKSPACE beyond that.
+ */
+enum ik_status ik_solve(const float target[3], LegPosition position_leg, float angles[3])
+{
+    enum ik_status status;
+    ik_batch[position_leg](&target[0], &target[1], &target[2], 1, &angles[0], &angles[1],
+                           &angles[2], &status);
+    return status;
+}
 
-    float beta_cos = (pow(FEMUR_LENGTH, 2) + pow(TIBIA_LENGTH, 2) - pow(G, 2))
-        / (2 * FEMUR_LENGTH * TIBIA_LENGTH);
-    float beta = acos(beta_cos);
+/**
+ * @brief solve the joint angles of many foot targets of one leg.
+ *
+ * ik_solve() over arrays: inputs and outputs are separate arrays per coordinate and the
+ * leg kernel is picked once, so the loop is straight-line float math with the
+ * orientation folded in that the compiler can vectorise. Scales from one robot tick to
+ * offline planning over thousands of targets.
+ *
+ * @param position_leg leg of all targets.
+ * @param x foot x of every target.
+ * @param y foot y of every target.
+ * @param z foot z of every target.
+ * @param count number of targets.
+ * @param theta1 coxa angles in degrees, out.
+ * @param theta2 femur angles in degrees, out.
+ * @param theta3 tibia angles in degrees, out.
+ * @param status reachability of every target, out; may be NULL.
+ */
+void inverse_kinematics_batch_leg(LegPosition position_leg, const float *restrict x,
+                                  const float *restrict y, const float *restrict z, int count,
+                                  float *restrict theta1, float *restrict theta2,
+                                  float *restrict theta3, enum ik_status *restrict status)
+{
+    ik_batch[position_leg](x, y, z, count, theta1, theta2, theta3, status);
+}
 
-    float theta2 = M_PI / 2 + (gamma - fabs(alpha));
+/**
+ * @brief solve the joint angles of many foot targets of any legs.
+ *
+ * Like inverse_kinematics_batch_leg(), with the leg kernel picked once per run of
+ * targets of the same leg.
+ *
+ * @param x foot x of every target.
+ * @param y foot y of every target.
+ * @param z foot z of every target.
+ * @param position leg of every target.
+ * @param count number of targets.
+ * @param theta1 coxa angles in degrees, out.
+ * @param theta2 femur angles in degrees, out.
+ * @param theta3 tibia angles in degrees, out.
+ * @param status reachability of every target, out; may be NULL.
+ */
+void inverse_kinematics_batch(const float *restrict x, const float *restrict y,
+                              const float *restrict z, const LegPosition *restrict position,
+                              int count, float *restrict theta1, float *restrict theta2,
+                              float *restrict theta3, enum ik_status *restrict status)
+{
+    int start = 0;
+    while (start < count) {
+        int end = start + 1;
+        while (end < count && position[end] == position[start]) {
+            end++;
+        }
+        ik_batch[position[start]](&x[start], &y[start], &z[start], end - start, &theta1[start],
+                                  &theta2[start], &theta3[start], status ? &status[start] : NULL);
+        start = end;
+    }
+}
 
-    float theta3 = M_PI - beta;
+/**
+ * @brief check stage: run forward kinematics on solved angles.
+ *
+ * Stores the foot position in leg->joints[3] like forward_kinematics(), without
+ * printing.
+ *
+ * @param leg leg the angles belong to.
+ * @param angles servo angles in degrees.
+ * @param position_leg leg position.
+ * @param target foot target the angles were solved for, NULL to skip the comparison.
+ * @return distance between the reached position and target, 0 without a target.
+ */
+float ik_verify(SpiderLeg *leg, const float angles[3], LegPosition position_leg,
+                const float target[3])
+{
+    forward_kinematics_position(angles, position_leg, leg->joints[3]);
+    if (!target) {
+        return 0.0f;
+    }
+    float dx = leg->joints[3][0] - fabsf(target[0]);
+    float dy = leg->joints[3][1] - fabsf(target[1]);
+    float dz = leg->joints[3][2] - target[2];
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
 
-    // Convert angles to degrees
-    theta1 = degrees(theta1);
-    theta2 = degrees(theta2);
-    theta3 = degrees(theta3);
+/**
+ * @brief foot position and its derivative by the servo angles.
+ *
+ * Derivative of the closed form in forward_kinematics_position(), so it follows the
+ * same DH chain: reach R and height w in the leg plane, turned by the coxa.
+ *
+ * @param angles servo angles in degrees.
+ * @param position_leg leg position.
+ * @param jacobian d position[i] / d angles[j] in mm per degree, out.
+ * @param position foot position x, y, z like forward_kinematics_position(), out.
+ */
+void leg_jacobian(const float angles[3], LegPosition position_leg, float jacobian[3][3],
+                  float position[3])
+{
+    const float k = M_PI / 180.0f; // rad per degree
+    struct leg_trig trig;
+    leg_trig[position_leg](angles, &trig);
+
+    float c0 = trig.c0, s0 = trig.s0;
+    float c1 = trig.c1, s1 = trig.s1;
+    float c12 = trig.c12, s12 = trig.s12;
+
+    float reach = COXA_LENGTH + FEMUR_LENGTH * c1 + TIBIA_LENGTH * c12;
+    float height = FEMUR_LENGTH * s1 + TIBIA_LENGTH * s12;
+
+    // by the DH joint angles; theta2 runs against the tibia servo
+    float dreach1 = -FEMUR_LENGTH * s1 - TIBIA_LENGTH * s12;
+    float dreach2 = -TIBIA_LENGTH * s12;
+    float dheight1 = FEMUR_LENGTH * c1 + TIBIA_LENGTH * c12;
+    float dheight2 = TIBIA_LENGTH * c12;
+
+    // x and y are reported as magnitudes
+    float px = reach * c0, py = reach * s0;
+    float sx = px < 0.0f ? -k : k;
+    float sy = py < 0.0f ? -k : k;
+
+    jacobian[0][0] = sx * -reach * s0;
+    jacobian[0][1] = sx * c0 * dreach1;
+    jacobian[0][2] = sx * c0 * -dreach2;
+    jacobian[1][0] = sy * reach * c0;
+    jacobian[1][1] = sy * s0 * dreach1;
+    jacobian[1][2] = sy * s0 * -dreach2;
+    jacobian[2][0] = 0.0f;
+    jacobian[2][1] = k * dheight1;
+    jacobian[2][2] = k * -dheight2;
+
+    position[0] = fabsf(px);
+    position[1] = fabsf(py);
+    position[2] = height;
+}
 
-    const float orientation_offset[NUM_LEGS] = { 0, -90.0, -180.0, -270.0 };
+/**
+ * @brief start differential IK from a full solve.
+ *
+ * @param tracker tracker to set up.
+ * @param position_leg leg position.
+ * @param target current foot target.
+ * @return status of the full solve.
+ */
+enum ik_status ik_tracker_init(struct ik_tracker *tracker, LegPosition position_leg,
+                               const float target[3])
+{
+    tracker->position = position_leg;
+    tracker->steps = 0;
+    tracker->resyncs = 1;
+    for (int i = 0; i < 3; i++) {
+        tracker->velocity[i] = 0.0f;
+    }
+    return ik_solve(target, position_leg, tracker->angles);
+}
 
-    theta1 += orientation_offset[position_leg];
+/**
+ * @brief move the tracked solution to a new foot target.
+ *
+ * One Newton step through the leg Jacobian from the previous angles, a 3x3 solve
+ * instead of the full trig chain. The step is clamped to the servo range and checked
+ * with forward_kinematics_position(). Falls back to ik_solve() every IK_DIFF_RESYNC
+ * steps, when the target jumps more than IK_DIFF_MAX_STEP, near singular poses (leg
+ * stretched or folded), and when the step hit a servo limit or missed the target by
+ * more than IK_DIFF_MAX_ERROR.
+ *
+ * @param tracker tracker set up with ik_tracker_init().
+ * @param target new foot target.
+ * @param dt time since the previous target in seconds, for the joint velocities.
+ * @param angles servo angles in degrees, out.
+ * @return IK_REACHABLE after a differential step within IK_DIFF_MAX_ERROR, else the
+ *         status of the full solve.
+ */
+enum ik_status ik_tracker_step(struct ik_tracker *tracker, const float target[3], float dt,
+                               float angles[3])
+{
+    float jacobian[3][3], position[3], delta[3], previous[3];
+    enum ik_status status = IK_REACHABLE;
 
-    // Ensure angles are within the valid range
-    theta1 = normalize_angle(theta1);
-    theta2 = normalize_angle(theta2);
-    theta3 = normalize_angle(theta3);
+    memcpy(previous, tracker->angles, sizeof(previous));
+    leg_jacobian(tracker->angles, tracker->position, jacobian, position);
+    for (int i = 0; i < 3; i++) {
+        delta[i] = target[i] - position[i];
+    }
 
-    if (theta1 > 90) {
-        theta1 = 180.0 - theta1;
+    // Cramer's rule, cofactors of the first row give the determinant
+    float (*J)[3] = jacobian;
+    float c00 = J[1][1] * J[2][2] - J[1][2] * J[2][1];
+    float c01 = J[1][2] * J[2][0] - J[1][0] * J[2][2];
+    float c02 = J[1][0] * J[2][1] - J[1][1] * J[2][0];
+    float det = J[0][0] * c00 + J[0][1] * c01 + J[0][2] * c02;
+    float step_sq = delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2];
+
+    int resync = ++tracker->steps >= IK_DIFF_RESYNC || fabsf(det) < IK_DIFF_MIN_DET
+        || step_sq > IK_DIFF_MAX_STEP * IK_DIFF_MAX_STEP;
+    if (!resync) {
+        float inv_det = 1.0f / det;
+        float d0 = (c00 * delta[0] + (J[0][2] * J[2][1] - J[0][1] * J[2][2]) * delta[1]
+                    + (J[0][1] * J[1][2] - J[0][2] * J[1][1]) * delta[2])
+            * inv_det;
+        float d1 = (c01 * delta[0] + (J[0][0] * J[2][2] - J[0][2] * J[2][0]) * delta[1]
+                    + (J[0][2] * J[1][0] - J[0][0] * J[1][2]) * delta[2])
+            * inv_det;
+        float d2 = (c02 * delta[0] + (J[0][1] * J[2][0] - J[0][0] * J[2][1]) * delta[1]
+                    + (J[0][0] * J[1][1] - J[0][1] * J[1][0]) * delta[2])
+            * inv_det;
+        float step[3] = { tracker->angles[0] + d0, tracker->angles[1] + d1,
+                          tracker->angles[2] + d2 };
+
+        // a servo limit or a miss is left to the full solve, which reports it honestly
+        for (int i = 0; i < 3 && !resync; i++) {
+            resync = !(step[i] >= 0.0f && step[i] <= 180.0f);
+        }
+        if (!resync) {
+            forward_kinematics_position(step, tracker->position, position);
+            float ex = position[0] - target[0];
+            float ey = position[1] - target[1];
+            float ez = position[2] - target[2];
+            resync = ex * ex + ey * ey + ez * ez > IK_DIFF_MAX_ERROR * IK_DIFF_MAX_ERROR;
+        }
+        if (!resync) {
+            memcpy(tracker->angles, step, sizeof(step));
+        }
+    }
+    if (resync) {
+        status = ik_solve(target, tracker->position, tracker->angles);
+        tracker->steps = 0;
+        tracker->resyncs++;
     }
 
-    float angles[3] = { theta1, theta2, theta3 };
-    set_angles(leg, angles);
-    forward_kinematics(leg, angles, position_leg);
-    // printf("theta1 = %.2f, theta2 = %.2f, theta3 = %.2f\n", theta1, theta2, theta3);
+    for (int i = 0; i < 3; i++) {
+        tracker->velocity[i] = dt > 0.0f ? (tracker->angles[i] - previous[i]) / dt : 0.0f;
+        angles[i] = tracker->angles[i];
+    }
+    return status;
 }
-
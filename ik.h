@@ -4,24 +4,66 @@
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
-#include "pwm_servo.h"
 #include "dh.h"
 #include "leg.h"
 
-#define DELTA_THETA_MAX 1
-#define DELAY_US 1000
 #define PWM_FREQ 50
+#define IK_CLAMP_MARGIN 5.0 // mm a target may lie outside the workspace and still be solved
+
+#define IK_DIFF_RESYNC 50 // differential IK steps between full solves
+#define IK_DIFF_MAX_STEP 10.0 // mm a target may move per step and still be tracked
+#define IK_DIFF_MIN_DET 1.0 // |det J| in (mm/deg)^3 below which the pose counts as singular
+#define IK_DIFF_MAX_ERROR 0.1 // mm a differential step may miss its target before a full solve
+
+/*
+ * Outcome of an IK solve, a statement about forward_kinematics_position() of the returned
+ * angles: the workspace is what the leg spans with every servo inside 0..180.
+ */
+enum ik_status
+{
+    IK_REACHABLE, // the angles put the foot on the target
+    IK_CLAMPED, // foot within IK_CLAMP_MARGIN of the target, as close as the leg gets
+    IK_OUT_OF_WORKSPACE // angles point at the target but the foot cannot get there
+};
 
 float to_degrees(float rad);
 float to_radians(float deg);
 float normalize_angle(float angle);
 float *get_target(SpiderLeg *leg);
 
-void set_angles(SpiderLeg *leg, float angles[3]);
+/* Differential IK state of one leg, advanced from target to target */
+struct ik_tracker
+{
+    LegPosition position;
+    float angles[3]; // last solution, servo degrees
+    float velocity[3]; // joint velocities of the last step, degrees per second
+    int steps; // differential steps since the last full solve
+    unsigned long resyncs; // full solves so far
+};
+
 void forward_kinematics(SpiderLeg *leg, float angles[3], LegPosition position_leg);
-void inverse_kinematics(SpiderLeg *leg, const float target_positions[3], LegPosition position_leg);
+void forward_kinematics_position(const float angles[3], LegPosition position_leg,
+                                 float position[3]);
+void forward_kinematics_dh(const float angles[3], LegPosition position_leg, float position[3]);
+void forward_kinematics_gsl(const float angles[3], LegPosition position_leg, float position[3]);
+enum ik_status ik_solve(const float target[3], LegPosition position_leg, float angles[3]);
+float ik_verify(SpiderLeg *leg, const float angles[3], LegPosition position_leg,
+                const float target[3]);
+void inverse_kinematics_batch_leg(LegPosition position_leg, const float *restrict x,
+                                  const float *restrict y, const float *restrict z, int count,
+                                  float *restrict theta1, float *restrict theta2,
+                                  float *restrict theta3, enum ik_status *restrict status);
+void inverse_kinematics_batch(const float *restrict x, const float *restrict y,
+                              const float *restrict z, const LegPosition *restrict position,
+                              int count, float *restrict theta1, float *restrict theta2,
+                              float *restrict theta3, enum ik_status *restrict status);
+void leg_jacobian(const float angles[3], LegPosition position_leg, float jacobian[3][3],
+                  float position[3]);
+enum ik_status ik_tracker_init(struct ik_tracker *tracker, LegPosition position_leg,
+                               const float target[3]);
+enum ik_status ik_tracker_step(struct ik_tracker *tracker, const float target[3], float dt,
+                               float angles[3]);
 
-void move_to_angle(SpiderLeg *leg, float target_angles[3], int speed);
 int angles_equal(const float angles1[3], const float angles2[3]);
 
 // coordinates
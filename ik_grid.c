@@ -0,0 +1,147 @@
+#include "ik_grid.h"
+
+/**
+ * @brief whether a cell can be interpolated, and how good its corners are.
+ *
+ * Compares the interpolation at the cell centre, where it is least accurate, with
+ * ik_solve().
+ */
+static uint8_t cell_status(const struct ik_grid *grid, int i, int j, int k)
+{
+    int status = IK_REACHABLE;
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int n = 0; n < 8; n++) {
+        int ci = i + (n >> 2), cj = j + ((n >> 1) & 1), ck = k + (n & 1);
+        if (grid->status[ci][cj][ck] > status) {
+            status = grid->status[ci][cj][ck];
+        }
+        for (int a = 0; a < 3; a++) {
+            mean[a] += grid->angles[ci][cj][ck][a] / 8.0f;
+        }
+    }
+    if (status == IK_OUT_OF_WORKSPACE) {
+        return IK_OUT_OF_WORKSPACE;
+    }
+
+    float centre[3] = { grid->min[0] + (i + 0.5f) * grid->step[0],
+                        grid->min[1] + (j + 0.5f) * grid->step[1],
+                        grid->min[2] + (k + 0.5f) * grid->step[2] };
+    float exact[3];
+    if (ik_solve(centre, grid->position, exact) == IK_OUT_OF_WORKSPACE) {
+        return IK_OUT_OF_WORKSPACE;
+    }
+    for (int a = 0; a < 3; a++) {
+        if (fabsf(exact[a] - mean[a]) > IK_GRID_MAX_ERROR) {
+            return IK_OUT_OF_WORKSPACE;
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief sample ik_solve() over the workspace grid of a leg.
+ *
+ * About 400 KB per leg; keep grids in static storage.
+ *
+ * @param grid grid to fill.
+ * @param position leg the grid is for.
+ */
+void ik_grid_build(struct ik_grid *grid, LegPosition position)
+{
+    const float lo[3] = { 0.0f, 0.0f, -IK_GRID_REACH };
+    const float hi[3] = { IK_GRID_REACH, IK_GRID_REACH, IK_GRID_REACH };
+
+    grid->position = position;
+    for (int a = 0; a < 3; a++) {
+        grid->min[a] = lo[a];
+        grid->step[a] = (hi[a] - lo[a]) / (IK_GRID_SIZE - 1);
+        grid->inv_step[a] = 1.0f / grid->step[a];
+    }
+
+    // one batch per grid line along z
+    float x[IK_GRID_SIZE], y[IK_GRID_SIZE], z[IK_GRID_SIZE];
+    float theta1[IK_GRID_SIZE], theta2[IK_GRID_SIZE], theta3[IK_GRID_SIZE];
+    enum ik_status status[IK_GRID_SIZE];
+    for (int k = 0; k < IK_GRID_SIZE; k++) {
+        z[k] = grid->min[2] + k * grid->step[2];
+    }
+    for (int i = 0; i < IK_GRID_SIZE; i++) {
+        for (int j = 0; j < IK_GRID_SIZE; j++) {
+            for (int k = 0; k < IK_GRID_SIZE; k++) {
+                x[k] = grid->min[0] + i * grid->step[0];
+                y[k] = grid->min[1] + j * grid->step[1];
+            }
+            inverse_kinematics_batch_leg(position, x, y, z, IK_GRID_SIZE, theta1, theta2, theta3,
+                                         status);
+            for (int k = 0; k < IK_GRID_SIZE; k++) {
+                grid->angles[i][j][k][0] = theta1[k];
+                grid->angles[i][j][k][1] = theta2[k];
+                grid->angles[i][j][k][2] = theta3[k];
+                grid->status[i][j][k] = status[k];
+            }
+        }
+    }
+
+    for (int i = 0; i < IK_GRID_SIZE - 1; i++) {
+        for (int j = 0; j < IK_GRID_SIZE - 1; j++) {
+            for (int k = 0; k < IK_GRID_SIZE - 1; k++) {
+                grid->cell_status[i][j][k] = cell_status(grid, i, j, k);
+            }
+        }
+    }
+}
+
+/**
+ * @brief approximate IK by trilinear interpolation between grid points.
+ *
+ * Only answers inside cells whose eight corners are solvable and whose interpolation
+ * stays within IK_GRID_MAX_ERROR of the exact solution at the centre, so the result
+ * never blends across the workspace boundary or an angle fold; fall back to ik_solve()
+ * on IK_OUT_OF_WORKSPACE.
+ * The error envelope is measured by ik_grid_report.
+ *
+ * @param grid grid built with ik_grid_build().
+ * @param target foot position x, y, z.
+ * @param angles servo angles in degrees, out; untouched on IK_OUT_OF_WORKSPACE.
+ * @return IK_CLAMPED if any surrounding point was clamped, IK_OUT_OF_WORKSPACE when the
+ *         target is outside the grid or in a cell that cannot be interpolated.
+ */
+enum ik_status ik_grid_solve(const struct ik_grid *grid, const float target[3], float angles[3])
+{
+    int cell[3];
+    float frac[3];
+
+    for (int a = 0; a < 3; a++) {
+        float u = (target[a] - grid->min[a]) * grid->inv_step[a];
+        if (!(u >= 0.0f && u <= IK_GRID_SIZE - 1)) {
+            return IK_OUT_OF_WORKSPACE;
+        }
+        cell[a] = (int)u;
+        if (cell[a] == IK_GRID_SIZE - 1) {
+            cell[a]--;
+        }
+        frac[a] = u - cell[a];
+    }
+
+    int status = grid->cell_status[cell[0]][cell[1]][cell[2]];
+    if (status == IK_OUT_OF_WORKSPACE) {
+        return IK_OUT_OF_WORKSPACE;
+    }
+
+    for (int k = 0; k < 3; k++) {
+        float c[8];
+        for (int n = 0; n < 8; n++) {
+            c[n] = grid->angles[cell[0] + (n >> 2)][cell[1] + ((n >> 1) & 1)][cell[2] + (n & 1)][k];
+        }
+        // along z, then y, then x
+        float c00 = c[0] + (c[1] - c[0]) * frac[2];
+        float c01 = c[2] + (c[3] - c[2]) * frac[2];
+        float c10 = c[4] + (c[5] - c[4]) * frac[2];
+        float c11 = c[6] + (c[7] - c[6]) * frac[2];
+        float c0 = c00 + (c01 - c00) * frac[1];
+        float c1 = c10 + (c11 - c10) * frac[1];
+        angles[k] = c0 + (c1 - c0) * frac[0];
+    }
+    return (enum ik_status)status;
+}
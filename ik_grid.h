@@ -0,0 +1,29 @@
+#ifndef IK_GRID_H
+#define IK_GRID_H
+
+#include <stdint.h>
+#include "ik.h"
+
+#define IK_GRID_SIZE 32 // grid points per axis
+#define IK_GRID_REACH (COXA_LENGTH + FEMUR_LENGTH + TIBIA_LENGTH) // farthest foot position
+#define IK_GRID_MAX_ERROR 1.0 // degrees a cell may miss ik_solve() by at its centre
+
+/* IK solutions sampled over the foot workspace of one leg: x and y in [0, IK_GRID_REACH],
+ * z in [-IK_GRID_REACH, IK_GRID_REACH] */
+struct ik_grid
+{
+    LegPosition position;
+    float min[3];
+    float step[3];
+    float inv_step[3];
+    float angles[IK_GRID_SIZE][IK_GRID_SIZE][IK_GRID_SIZE][3];
+    uint8_t status[IK_GRID_SIZE][IK_GRID_SIZE][IK_GRID_SIZE]; // enum ik_status
+    // worst status of the 8 corners of a cell, IK_OUT_OF_WORKSPACE also where interpolation
+    // misses by more than IK_GRID_MAX_ERROR (folds, singularities, workspace edge)
+    uint8_t cell_status[IK_GRID_SIZE - 1][IK_GRID_SIZE - 1][IK_GRID_SIZE - 1];
+};
+
+void ik_grid_build(struct ik_grid *grid, LegPosition position);
+enum ik_status ik_grid_solve(const struct ik_grid *grid, const float target[3], float angles[3]);
+
+#endif // IK_GRID_H
@@ -0,0 +1,96 @@
+#include "bench_util.h"
+#include "ik_grid.h"
+
+// error envelope and speed of the IK grid against the analytic solver
+
+#define REPORT_SAMPLES 200000
+#define REPORT_SEED 12345
+
+static struct ik_grid grid;
+static float angle_err[REPORT_SAMPLES];
+static float fk_err[REPORT_SAMPLES];
+static float grid_trip_err[REPORT_SAMPLES];
+static float exact_trip_err[REPORT_SAMPLES];
+static float targets[REPORT_SAMPLES][3];
+
+static float distance(const float a[3], const float b[3])
+{
+    float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+static void print_percentiles(const char *name, const char *unit, float *values, int count)
+{
+    float p[BENCH_PERCENTILES];
+    percentiles(values, count, p);
+    printf("  %-22s p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f %s\n", name, p[0], p[1], p[2],
+           p[3], unit);
+}
+
+int main(void)
+{
+    int count = 0, missed = 0;
+
+    ik_grid_build(&grid, KANAN_DEPAN);
+
+    // random reachable targets inside the grid
+    srand(REPORT_SEED);
+    while (count < REPORT_SAMPLES) {
+        float target[3], angles[3];
+        for (int a = 0; a < 3; a++) {
+            float span = grid.step[a] * (IK_GRID_SIZE - 1);
+            target[a] = grid.min[a] + span * rand() / (float)RAND_MAX;
+        }
+        if (ik_solve(target, KANAN_DEPAN, angles) != IK_REACHABLE) {
+            continue;
+        }
+        memcpy(targets[count++], target, sizeof(target));
+    }
+
+    int answered = 0;
+    for (int i = 0; i < count; i++) {
+        float exact[3], approx[3], exact_pos[3], approx_pos[3];
+        ik_solve(targets[i], KANAN_DEPAN, exact);
+        if (ik_grid_solve(&grid, targets[i], approx) == IK_OUT_OF_WORKSPACE) {
+            missed++;
+            continue;
+        }
+        float err = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            err = fmaxf(err, fabsf(approx[k] - exact[k]));
+        }
+        forward_kinematics_position(exact, KANAN_DEPAN, exact_pos);
+        forward_kinematics_position(approx, KANAN_DEPAN, approx_pos);
+        angle_err[answered] = err;
+        fk_err[answered] = distance(approx_pos, exact_pos);
+        grid_trip_err[answered] = distance(approx_pos, targets[i]);
+        exact_trip_err[answered] = distance(exact_pos, targets[i]);
+        answered++;
+    }
+
+    // timing over the same targets
+    float sink = 0.0f, angles[3];
+    double start = now_ns();
+    for (int i = 0; i < count; i++) {
+        ik_solve(targets[i], KANAN_DEPAN, angles);
+        sink += angles[0];
+    }
+    double exact_ns = (now_ns() - start) / count;
+    start = now_ns();
+    for (int i = 0; i < count; i++) {
+        ik_grid_solve(&grid, targets[i], angles);
+        sink += angles[0];
+    }
+    double grid_ns = (now_ns() - start) / count;
+
+    printf("ik grid %d^3, step %.1f/%.1f/%.1f mm, %d reachable targets\n", IK_GRID_SIZE,
+           grid.step[0], grid.step[1], grid.step[2], count);
+    printf("  answered by grid       %.1f%% (%d in cells left to ik_solve)\n",
+           100.0 * answered / count, missed);
+    print_percentiles("joint angle error", "deg", angle_err, answered);
+    print_percentiles("foot vs analytic", "mm", fk_err, answered);
+    print_percentiles("grid FK round trip", "mm", grid_trip_err, answered);
+    print_percentiles("analytic FK round trip", "mm", exact_trip_err, answered);
+    printf("  ik_solve %.1f ns/call, grid %.1f ns/call (checksum %g)\n", exact_ns, grid_ns, sink);
+    return 0;
+}
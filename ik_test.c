@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include "ik.h"
+
+// leg Jacobian and differential IK against the closed form and the full solve, run with
+// `make check`
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                            \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+            failures++;                                                                            \
+        }                                                                                          \
+    } while (0)
+
+#define TEST_ANGLE_STEP 15 // degrees between Jacobian test poses
+#define TEST_DIFF_STEP 0.1f // degrees, central difference step
+#define TEST_JACOBIAN_TOLERANCE 1e-2f // mm per degree
+#define TEST_PATH_STEPS 200 // tracker targets along the path, two laps
+#define TEST_ANGLE_TOLERANCE 0.05f // degrees between tracker and ik_solve
+
+/**
+ * @brief distance between two foot positions.
+ */
+static float distance(const float a[3], const float b[3])
+{
+    float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+/**
+ * @brief leg_jacobian() matches central differences of forward_kinematics_position().
+ */
+static void test_jacobian(LegPosition leg)
+{
+    float worst = 0.0f;
+
+    for (int a0 = 15; a0 < 180; a0 += TEST_ANGLE_STEP) {
+        for (int a1 = 15; a1 < 180; a1 += TEST_ANGLE_STEP) {
+            for (int a2 = 15; a2 < 180; a2 += TEST_ANGLE_STEP) {
+                float angles[3] = { a0, a1, a2 };
+                float jacobian[3][3], position[3], reference[3];
+                leg_jacobian(angles, leg, jacobian, position);
+                forward_kinematics_position(angles, leg, reference);
+                CHECK(distance(position, reference) < 1e-3f,
+                      "leg %d (%d, %d, %d): jacobian position off", leg, a0, a1, a2);
+
+                // x and y are magnitudes, not differentiable where the foot crosses an axis
+                if (position[0] < 1.0f || position[1] < 1.0f) {
+                    continue;
+                }
+                for (int j = 0; j < 3; j++) {
+                    float plus[3] = { angles[0], angles[1], angles[2] };
+                    float minus[3] = { angles[0], angles[1], angles[2] };
+                    float p[3], m[3];
+                    plus[j] += TEST_DIFF_STEP;
+                    minus[j] -= TEST_DIFF_STEP;
+                    forward_kinematics_position(plus, leg, p);
+                    forward_kinematics_position(minus, leg, m);
+                    for (int i = 0; i < 3; i++) {
+                        float diff = (p[i] - m[i]) / (2.0f * TEST_DIFF_STEP);
+                        worst = fmaxf(worst, fabsf(jacobian[i][j] - diff));
+                    }
+                }
+            }
+        }
+    }
+    CHECK(worst < TEST_JACOBIAN_TOLERANCE, "leg %d: jacobian off the differences by %g mm/deg",
+          leg, worst);
+}
+
+/**
+ * @brief the tracker follows a path with the angles and status ik_solve() gives.
+ */
+static void test_tracker_path(LegPosition leg, const float centre[3], float radius)
+{
+    struct ik_tracker tracker;
+    float worst_angle = 0.0f, worst_miss = 0.0f;
+
+    CHECK(ik_tracker_init(&tracker, leg, centre) == IK_REACHABLE, "leg %d: centre not reachable",
+          leg);
+    for (int n = 1; n <= TEST_PATH_STEPS; n++) {
+        float phase = 4.0f * (float)M_PI * n / TEST_PATH_STEPS;
+        float target[3] = { centre[0] + radius * (cosf(phase) - 1.0f),
+                            centre[1] + radius * sinf(phase),
+                            centre[2] + 0.5f * radius * sinf(2.0f * phase) };
+        float angles[3], solved[3], position[3];
+        enum ik_status status = ik_tracker_step(&tracker, target, 0.01f, angles);
+        enum ik_status expected = ik_solve(target, leg, solved);
+
+        CHECK(status == expected, "leg %d step %d: status %d, ik_solve says %d", leg, n, status,
+              expected);
+        for (int i = 0; i < 3; i++) {
+            CHECK(angles[i] >= 0.0f && angles[i] <= 180.0f, "leg %d step %d: theta%d %g", leg, n,
+                  i + 1, angles[i]);
+            worst_angle = fmaxf(worst_angle, fabsf(angles[i] - solved[i]));
+        }
+        forward_kinematics_position(angles, leg, position);
+        worst_miss = fmaxf(worst_miss, distance(position, target));
+    }
+    CHECK(worst_angle < TEST_ANGLE_TOLERANCE, "leg %d: tracker %g degrees off ik_solve", leg,
+          worst_angle);
+    CHECK(worst_miss <= IK_DIFF_MAX_ERROR, "leg %d: tracked foot missed by %g mm", leg,
+          worst_miss);
+    // the point of tracking: most steps are differential
+    CHECK(tracker.resyncs <= 1 + TEST_PATH_STEPS / IK_DIFF_RESYNC, "leg %d: %lu full solves",
+          leg, tracker.resyncs);
+}
+
+/**
+ * @brief a target the femur cannot reach inside 0..180 is not reported reachable.
+ */
+static void test_tracker_out_of_range(LegPosition leg)
+{
+    const float start[3] = { 120.0f, 60.0f, -120.0f };
+    struct ik_tracker tracker;
+    float angles[3], solved[3];
+
+    ik_tracker_init(&tracker, leg, start);
+    // walk up in steps the tracker takes differentially, past where the femur runs out
+    for (float z = -115.0f; z <= -60.0f; z += 5.0f) {
+        float target[3] = { start[0], start[1], z };
+        enum ik_status status = ik_tracker_step(&tracker, target, 0.01f, angles);
+        CHECK(status == ik_solve(target, leg, solved), "leg %d z %.0f: status %d differs", leg,
+              z, status);
+        for (int i = 0; i < 3; i++) {
+            CHECK(angles[i] >= 0.0f && angles[i] <= 180.0f, "leg %d z %.0f: theta%d %g", leg, z,
+                  i + 1, angles[i]);
+        }
+    }
+    float target[3] = { start[0], start[1], -60.0f };
+    CHECK(ik_tracker_step(&tracker, target, 0.01f, angles) != IK_REACHABLE,
+          "leg %d: (120, 60, -60) needs the femur past 180 but was reachable", leg);
+}
+
+int main(void)
+{
+    const float centre[3] = { 120.0f, 60.0f, -120.0f };
+
+    for (int leg = 0; leg < NUM_LEGS; leg++) {
+        test_jacobian((LegPosition)leg);
+        test_tracker_path((LegPosition)leg, centre, 20.0f);
+        test_tracker_out_of_range((LegPosition)leg);
+    }
+
+    printf("%s\n", failures ? "ik test FAILED" : "ik test passed");
+    return failures ? 1 : 0;
+}
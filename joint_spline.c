@@ -0,0 +1,85 @@
+#include "joint_spline.h"
+
+/**
+ * @brief fit a cubic spline through keyframes of one joint.
+ *
+ * In units of the keyframe spacing the second derivatives M at the inner keyframes
+ * solve M[i - 1] + 4 M[i] + M[i + 1] = 6 (y[i - 1] - 2 y[i] + y[i + 1]). Not-a-knot ends,
+ * M[0] = 2 M[1] - M[2] and the mirror at the far end, need no end slopes and reduce the
+ * first and last rows to 6 M. Solved with the Thomas algorithm; no allocation, the work
+ * arrays are sized by JOINT_SPLINE_MAX_KEYS.
+ *
+ * @param spline spline to fill.
+ * @param values joint angle at every keyframe.
+ * @param nkeys number of keyframes, JOINT_SPLINE_MIN_KEYS..JOINT_SPLINE_MAX_KEYS.
+ * @param start phase of the first keyframe.
+ * @param span phase from the first to the last keyframe, positive.
+ * @return 0, -1 if nkeys is out of range and the spline was left untouched.
+ */
+int joint_spline_fit(struct joint_spline *spline, const float *values, int nkeys, float start,
+                     float span)
+{
+    double diag[JOINT_SPLINE_MAX_KEYS];
+    double m[JOINT_SPLINE_MAX_KEYS]; // second derivatives
+
+    if (nkeys < JOINT_SPLINE_MIN_KEYS || nkeys > JOINT_SPLINE_MAX_KEYS) {
+        return -1;
+    }
+
+    const int last = nkeys - 2; // last inner keyframe
+    for (int i = 1; i <= last; i++) {
+        diag[i] = 4.0;
+        m[i] = 6.0 * ((double)values[i - 1] - 2.0 * values[i] + values[i + 1]);
+    }
+    diag[1] = 6.0;
+    diag[last] = 6.0;
+
+    // off-diagonals are 1, except the zeroed upper one of the first row and lower one of
+    // the last row
+    for (int i = 2; i <= last; i++) {
+        double lower = i == last ? 0.0 : 1.0;
+        double upper = i == 2 ? 0.0 : 1.0;
+        double factor = lower / diag[i - 1];
+        diag[i] -= factor * upper;
+        m[i] -= factor * m[i - 1];
+    }
+    m[last] /= diag[last];
+    for (int i = last - 1; i >= 1; i--) {
+        double upper = i == 1 ? 0.0 : 1.0;
+        m[i] = (m[i] - upper * m[i + 1]) / diag[i];
+    }
+    m[0] = 2.0 * m[1] - m[2];
+    m[nkeys - 1] = 2.0 * m[last] - m[last - 1];
+
+    spline->nkeys = nkeys;
+    spline->start = start;
+    spline->inv_step = (nkeys - 1) / span;
+    for (int i = 0; i < nkeys - 1; i++) {
+        spline->coef[i][0] = values[i];
+        spline->coef[i][1] = (values[i + 1] - values[i]) - (2.0 * m[i] + m[i + 1]) / 6.0;
+        spline->coef[i][2] = m[i] / 2.0;
+        spline->coef[i][3] = (m[i + 1] - m[i]) / 6.0;
+    }
+    return 0;
+}
+
+/**
+ * @brief joint angle at a phase, O(1) with Horner's method.
+ *
+ * @param spline fitted spline.
+ * @param phase phase, clamped to the keyframes of the spline.
+ * @return joint angle.
+ */
+float joint_spline_eval(const struct joint_spline *spline, float phase)
+{
+    float u = (phase - spline->start) * spline->inv_step;
+    u = fmaxf(0.0f, fminf(u, spline->nkeys - 1));
+    int i = (int)u;
+    if (i == spline->nkeys - 1) {
+        i--;
+    }
+    u -= i;
+
+    const float *c = spline->coef[i];
+    return c[0] + u * (c[1] + u * (c[2] + u * c[3]));
+}
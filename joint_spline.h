@@ -0,0 +1,24 @@
+#ifndef JOINT_SPLINE_H
+#define JOINT_SPLINE_H
+
+#include <math.h>
+
+#define JOINT_SPLINE_MIN_KEYS 4
+#define JOINT_SPLINE_MAX_KEYS 32
+
+/* Cubic spline of one joint through keyframes evenly spaced over [start, start + span] of
+ * a cycle, not-a-knot ends; interval i is coef[i][0] + coef[i][1] u + coef[i][2] u^2 +
+ * coef[i][3] u^3 over u in [0, 1] between keyframes i and i + 1 */
+struct joint_spline
+{
+    int nkeys;
+    float start; // phase of the first keyframe
+    float inv_step; // 1 / phase between keyframes
+    float coef[JOINT_SPLINE_MAX_KEYS - 1][4];
+};
+
+int joint_spline_fit(struct joint_spline *spline, const float *values, int nkeys, float start,
+                     float span);
+float joint_spline_eval(const struct joint_spline *spline, float phase);
+
+#endif // JOINT_SPLINE_H
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include "joint_spline.h"
+
+// keyframe splines of the gait joints, run with `make check`
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                            \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+            failures++;                                                                            \
+        }                                                                                          \
+    } while (0)
+
+#define TEST_SAMPLES 1000 // evaluation points over the keyframes
+#define TEST_TOLERANCE 1e-3f // degrees, float round-off of a fit over 0..180
+
+/**
+ * @brief a joint angle that is a cubic of the phase.
+ */
+static float cubic(float phase)
+{
+    return 90.0f + phase * (-40.0f + phase * (150.0f + phase * -120.0f));
+}
+
+/**
+ * @brief not-a-knot splines reproduce a cubic exactly, between the keyframes as well.
+ */
+static void test_cubic(int nkeys, float start, float span)
+{
+    struct joint_spline spline;
+    float values[JOINT_SPLINE_MAX_KEYS];
+
+    for (int i = 0; i < nkeys; i++) {
+        values[i] = cubic(start + span * i / (nkeys - 1));
+    }
+    CHECK(joint_spline_fit(&spline, values, nkeys, start, span) == 0, "%d keys: fit failed",
+          nkeys);
+
+    float worst = 0.0f;
+    for (int n = 0; n <= TEST_SAMPLES; n++) {
+        float phase = start + span * n / TEST_SAMPLES;
+        worst = fmaxf(worst, fabsf(joint_spline_eval(&spline, phase) - cubic(phase)));
+    }
+    CHECK(worst < TEST_TOLERANCE, "%d keys over [%.2f, %.2f]: off the cubic by %g", nkeys, start,
+          start + span, worst);
+
+    // phases outside the keyframes hold the end values
+    CHECK(fabsf(joint_spline_eval(&spline, start - 0.1f) - values[0]) < TEST_TOLERANCE,
+          "%d keys: not clamped before the first keyframe", nkeys);
+    CHECK(fabsf(joint_spline_eval(&spline, start + span + 0.1f) - values[nkeys - 1]) <
+              TEST_TOLERANCE,
+          "%d keys: not clamped after the last keyframe", nkeys);
+}
+
+static void test_key_count(void)
+{
+    struct joint_spline spline = { 0 };
+    float values[JOINT_SPLINE_MAX_KEYS + 1] = { 0 };
+
+    CHECK(joint_spline_fit(&spline, values, JOINT_SPLINE_MIN_KEYS - 1, 0.0f, 1.0f) < 0,
+          "fit accepted %d keys", JOINT_SPLINE_MIN_KEYS - 1);
+    CHECK(joint_spline_fit(&spline, values, JOINT_SPLINE_MAX_KEYS + 1, 0.0f, 1.0f) < 0,
+          "fit accepted %d keys", JOINT_SPLINE_MAX_KEYS + 1);
+    CHECK(spline.nkeys == 0, "rejected fit changed the spline");
+}
+
+int main(void)
+{
+    test_cubic(JOINT_SPLINE_MIN_KEYS, 0.0f, 1.0f);
+    test_cubic(7, 0.25f, 0.5f);
+    test_cubic(JOINT_SPLINE_MAX_KEYS, 0.1f, 0.8f);
+    test_key_count();
+
+    printf("%s\n", failures ? "joint spline test FAILED" : "joint spline test passed");
+    return failures ? 1 : 0;
+}
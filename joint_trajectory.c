@@ -0,0 +1,132 @@
+#include "joint_trajectory.h"
+
+// peak velocity and acceleration of the minimum jerk scaling over a unit move in unit time
+#define MIN_JERK_PEAK_VELOCITY 1.875 // 15 / 8 at s = 0.5
+#define MIN_JERK_PEAK_ACCELERATION 5.7735027 // 10 / sqrt(3) at s = (3 - sqrt(3)) / 6
+
+/**
+ * @brief the same limits for every joint.
+ */
+void joint_limits_init(struct joint_limits *limits, float velocity, float acceleration)
+{
+    for (int i = 0; i < JOINT_TRAJECTORY_MAX_JOINTS; i++) {
+        limits->velocity[i] = velocity;
+        limits->acceleration[i] = acceleration;
+    }
+}
+
+/**
+ * @brief plan a synchronised move of every joint, as short as the limits allow.
+ *
+ * With A the longest |delta| / velocity limit and B the longest |delta| / acceleration
+ * limit over the joints, the minimum jerk move takes max(1.875 A, sqrt(5.77 B)). The
+ * trapezoid accelerating for a share f of the move peaks at |delta| / (T (1 - f)) and
+ * |delta| / (T^2 f (1 - f)), shortest at f = B / (A^2 + B), T = A + B / A, or as a
+ * triangle f = 1/2, T = 2 sqrt(B) once B >= A^2.
+ *
+ * @param traj trajectory to plan.
+ * @param profile time scaling.
+ * @param njoints number of joints, at most JOINT_TRAJECTORY_MAX_JOINTS.
+ * @param start current angles in degrees.
+ * @param goal target angles in degrees.
+ * @param limits velocity and acceleration limit of every joint, must be positive.
+ * @param rate control rate the samples are emitted at, Hz.
+ */
+void joint_trajectory_plan(struct joint_trajectory *traj, enum joint_profile profile, int njoints,
+                           const float *start, const float *goal,
+                           const struct joint_limits *limits, float rate)
+{
+    float a = 0.0f, b = 0.0f;
+
+    if (njoints > JOINT_TRAJECTORY_MAX_JOINTS) {
+        njoints = JOINT_TRAJECTORY_MAX_JOINTS;
+    }
+    traj->profile = profile;
+    traj->njoints = njoints;
+    traj->rate = rate;
+    traj->sample = 0;
+    for (int i = 0; i < njoints; i++) {
+        traj->start[i] = start[i];
+        traj->delta[i] = goal[i] - start[i];
+        a = fmaxf(a, fabsf(traj->delta[i]) / limits->velocity[i]);
+        b = fmaxf(b, fabsf(traj->delta[i]) / limits->acceleration[i]);
+    }
+
+    traj->blend = 0.5f;
+    if (a <= 0.0f) {
+        traj->duration = 0.0f;
+    } else if (profile == JOINT_PROFILE_MIN_JERK) {
+        traj->duration = fmaxf(MIN_JERK_PEAK_VELOCITY * a, sqrtf(MIN_JERK_PEAK_ACCELERATION * b));
+    } else if (b >= a * a) {
+        traj->duration = 2.0f * sqrtf(b);
+    } else {
+        traj->blend = b / (a * a + b);
+        traj->duration = a + b / a;
+    }
+
+    // one sample per control period, the last one lands on or after the end of the move
+    traj->nsamples = (int)ceilf(traj->duration * rate);
+    if (traj->nsamples < 1) {
+        traj->nsamples = 1;
+    }
+}
+
+/**
+ * @brief share s in [0, 1] of the move done at normalised time u in [0, 1].
+ */
+static float joint_trajectory_scale(const struct joint_trajectory *traj, float u)
+{
+    if (traj->profile == JOINT_PROFILE_MIN_JERK) {
+        return u * u * u * (10.0f + u * (-15.0f + u * 6.0f));
+    }
+
+    float f = traj->blend;
+    float peak = 1.0f / (1.0f - f); // cruise velocity in moves per unit time
+    if (u < f) {
+        return peak * u * u / (2.0f * f);
+    }
+    if (u <= 1.0f - f) {
+        return peak * (u - 0.5f * f);
+    }
+    float left = 1.0f - u;
+    return 1.0f - peak * left * left / (2.0f * f);
+}
+
+/**
+ * @brief angles of every joint at a time into the move.
+ *
+ * @param traj planned trajectory.
+ * @param time seconds since the start, clamped to the move.
+ * @param angles angle of every joint, out.
+ */
+void joint_trajectory_eval(const struct joint_trajectory *traj, float time, float *angles)
+{
+    float u = traj->duration > 0.0f ? time / traj->duration : 1.0f;
+    float s = joint_trajectory_scale(traj, fmaxf(0.0f, fminf(u, 1.0f)));
+    for (int i = 0; i < traj->njoints; i++) {
+        angles[i] = traj->start[i] + traj->delta[i] * s;
+    }
+}
+
+/**
+ * @brief next control period's angles.
+ *
+ * @param traj planned trajectory.
+ * @param angles angle of every joint, out; untouched once the move is done.
+ * @return 1 while samples remain, the last one being the goal, 0 after it.
+ */
+int joint_trajectory_next(struct joint_trajectory *traj, float *angles)
+{
+    if (traj->sample >= traj->nsamples) {
+        return 0;
+    }
+    traj->sample++;
+    if (traj->sample == traj->nsamples) {
+        for (int i = 0; i < traj->njoints; i++) {
+            angles[i] = traj->start[i] + traj->delta[i];
+        }
+        return 1;
+    }
+    joint_trajectory_eval(traj, traj->sample / traj->rate, angles);
+    return 1;
+}
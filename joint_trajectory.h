@@ -0,0 +1,47 @@
+#ifndef JOINT_TRAJECTORY_H
+#define JOINT_TRAJECTORY_H
+
+#include <math.h>
+#include "leg.h"
+
+#define JOINT_TRAJECTORY_MAX_JOINTS (NUM_LEGS * 3)
+#define JOINT_MAX_VELOCITY 300.0 // deg/s, default servo limit, under the no load speed
+#define JOINT_MAX_ACCELERATION 1500.0 // deg/s^2, default servo limit
+
+/* Time scaling shared by every joint of a move */
+enum joint_profile
+{
+    JOINT_PROFILE_MIN_JERK, // 10u^3 - 15u^4 + 6u^5, no velocity or acceleration at the ends
+    JOINT_PROFILE_TRAPEZOID // constant acceleration, cruise, constant deceleration
+};
+
+/* Limits of every joint, degrees per second and degrees per second squared */
+struct joint_limits
+{
+    float velocity[JOINT_TRAJECTORY_MAX_JOINTS];
+    float acceleration[JOINT_TRAJECTORY_MAX_JOINTS];
+};
+
+/* Synchronised move of every joint from start to start + delta: the joints share one time
+ * scaling stretched to the joint that needs longest, so they start and finish together */
+struct joint_trajectory
+{
+    enum joint_profile profile;
+    int njoints;
+    float start[JOINT_TRAJECTORY_MAX_JOINTS];
+    float delta[JOINT_TRAJECTORY_MAX_JOINTS];
+    float duration; // seconds
+    float blend; // trapezoid: share of the duration spent accelerating, and decelerating
+    float rate; // samples per second
+    int nsamples; // samples after the start pose, the last one is the goal
+    int sample; // samples emitted so far
+};
+
+void joint_limits_init(struct joint_limits *limits, float velocity, float acceleration);
+void joint_trajectory_plan(struct joint_trajectory *traj, enum joint_profile profile, int njoints,
+                           const float *start, const float *goal,
+                           const struct joint_limits *limits, float rate);
+void joint_trajectory_eval(const struct joint_trajectory *traj, float time, float *angles);
+int joint_trajectory_next(struct joint_trajectory *traj, float *angles);
+
+#endif // JOINT_TRAJECTORY_H
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include "joint_trajectory.h"
+
+// synchronised joint moves planned within the servo limits, run with `make check`
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                            \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+            failures++;                                                                            \
+        }                                                                                          \
+    } while (0)
+
+#define TEST_JOINTS 6
+#define TEST_RATE 100.0f
+#define TEST_STEPS 200 // evaluation steps over a move for the numeric derivatives
+#define TEST_TOLERANCE 0.02f // float round-off of the second differences
+
+static const char *profile_names[] = { "min jerk", "trapezoid" };
+
+/**
+ * @brief peak velocity and acceleration of every joint from finite differences.
+ *
+ * Measured on the move shifted to start at 0, so the float round-off of the absolute
+ * angles does not swamp the second differences of short moves.
+ */
+static void measure_peaks(const struct joint_trajectory *move, float *velocity,
+                          float *acceleration)
+{
+    struct joint_trajectory shifted = *move;
+    const struct joint_trajectory *traj = &shifted;
+    float prev[TEST_JOINTS], cur[TEST_JOINTS], next[TEST_JOINTS];
+    float dt = traj->duration / TEST_STEPS;
+
+    for (int j = 0; j < traj->njoints; j++) {
+        shifted.start[j] = 0.0f;
+    }
+
+    for (int j = 0; j < traj->njoints; j++) {
+        velocity[j] = acceleration[j] = 0.0f;
+    }
+    joint_trajectory_eval(traj, 0.0f, prev);
+    joint_trajectory_eval(traj, dt, cur);
+    for (int n = 1; n < TEST_STEPS; n++) {
+        joint_trajectory_eval(traj, (n + 1) * dt, next);
+        for (int j = 0; j < traj->njoints; j++) {
+            velocity[j] = fmaxf(velocity[j], fabsf(next[j] - prev[j]) / (2.0f * dt));
+            acceleration[j] =
+                fmaxf(acceleration[j], fabsf(next[j] - 2.0f * cur[j] + prev[j]) / (dt * dt));
+        }
+        for (int j = 0; j < traj->njoints; j++) {
+            prev[j] = cur[j];
+            cur[j] = next[j];
+        }
+    }
+}
+
+/**
+ * @brief plan one move and check its limits and its synchronised finish.
+ *
+ * @param profile time scaling.
+ * @param start start angles.
+ * @param goal goal angles.
+ * @param velocity velocity limit of every joint.
+ * @param acceleration acceleration limit of every joint.
+ */
+static void check_move(enum joint_profile profile, const float *start, const float *goal,
+                       float velocity, float acceleration)
+{
+    struct joint_limits limits;
+    struct joint_trajectory traj;
+    float peak_velocity[TEST_JOINTS], peak_acceleration[TEST_JOINTS];
+    const char *name = profile_names[profile];
+
+    joint_limits_init(&limits, velocity, acceleration);
+    joint_trajectory_plan(&traj, profile, TEST_JOINTS, start, goal, &limits, TEST_RATE);
+    CHECK(traj.duration > 0.0f, "%s: no duration", name);
+
+    // within the limits, and the joint that sets the duration gets close to one of them
+    measure_peaks(&traj, peak_velocity, peak_acceleration);
+    float usage = 0.0f;
+    for (int j = 0; j < TEST_JOINTS; j++) {
+        CHECK(peak_velocity[j] <= velocity * (1.0f + TEST_TOLERANCE),
+              "%s: joint %d velocity %.1f over %.1f", name, j, peak_velocity[j], velocity);
+        CHECK(peak_acceleration[j] <= acceleration * (1.0f + TEST_TOLERANCE),
+              "%s: joint %d acceleration %.1f over %.1f", name, j, peak_acceleration[j],
+              acceleration);
+        usage = fmaxf(usage, fmaxf(peak_velocity[j] / velocity,
+                                   peak_acceleration[j] / acceleration));
+    }
+    CHECK(usage > 1.0f - TEST_TOLERANCE, "%s: move slower than needed, %.3f of the limits",
+          name, usage);
+
+    // every joint covers the same share of its move at the same time
+    for (int n = 1; n < 20; n++) {
+        float angles[TEST_JOINTS];
+        joint_trajectory_eval(&traj, traj.duration * n / 20.0f, angles);
+        float share = (angles[0] - start[0]) / (goal[0] - start[0]);
+        for (int j = 1; j < TEST_JOINTS; j++) {
+            float delta = goal[j] - start[j];
+            if (delta != 0.0f) {
+                CHECK(fabsf((angles[j] - start[j]) / delta - share) < 1e-4f,
+                      "%s: joint %d out of step at %d/20", name, j, n);
+            }
+        }
+    }
+
+    // the control rate samples cover the whole move and end on the goal together
+    float angles[TEST_JOINTS];
+    int samples = 0;
+    while (joint_trajectory_next(&traj, angles)) {
+        samples++;
+    }
+    CHECK(samples == traj.nsamples, "%s: %d samples, planned %d", name, samples, traj.nsamples);
+    CHECK(samples >= traj.duration * TEST_RATE, "%s: %d samples for %.3f s", name, samples,
+          traj.duration);
+    for (int j = 0; j < TEST_JOINTS; j++) {
+        CHECK(angles[j] == goal[j], "%s: joint %d ends at %f, goal %f", name, j, angles[j],
+              goal[j]);
+    }
+}
+
+int main(void)
+{
+    static const float start[TEST_JOINTS] = { 90.0f, 90.0f, 90.0f, 45.0f, 120.0f, 10.0f };
+    static const float goal[TEST_JOINTS] = { 150.0f, 80.0f, 90.0f, 135.0f, 60.0f, 11.0f };
+    static const float small_goal[TEST_JOINTS] = { 92.0f, 89.0f, 90.0f, 46.0f, 119.0f, 10.5f };
+
+    for (int p = JOINT_PROFILE_MIN_JERK; p <= JOINT_PROFILE_TRAPEZOID; p++) {
+        // velocity bound, acceleration bound and the triangle trapezoid
+        check_move(p, start, goal, JOINT_MAX_VELOCITY, JOINT_MAX_ACCELERATION);
+        check_move(p, start, goal, 60.0f, 5000.0f);
+        check_move(p, start, small_goal, JOINT_MAX_VELOCITY, JOINT_MAX_ACCELERATION);
+    }
+
+    printf("%s\n", failures ? "joint trajectory test FAILED" : "joint trajectory test passed");
+    return failures ? 1 : 0;
+}
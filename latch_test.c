@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include "pca9685_sim.h"
+#include "pwm_servo.h"
+
+// frame latching against the simulated PCA9685s, run with `make check`
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                           \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                            \
+            printf(__VA_ARGS__);                                                                   \
+            printf("\n");                                                                          \
+            failures++;                                                                            \
+        }                                                                                          \
+    } while (0)
+
+static struct pca9685_sim_bus *bus;
+
+/**
+ * @brief stage a pose on both controllers, every channel a different value.
+ */
+static void stage_pose(struct pwm_frame *frame, int base)
+{
+    pwm_frame_init(frame);
+    for (int joint = 1; joint <= 2 * NUM_CHANNELS; joint++) {
+        pwm_frame_set(frame, joint, joint, base + 10 * joint);
+    }
+}
+
+/**
+ * @brief collect the latch events of all outputs and check they run the frame values.
+ *
+ * @return number of distinct latch events seen.
+ */
+static int check_outputs(const struct pwm_frame *frame)
+{
+    unsigned long events[2 * NUM_CHANNELS];
+    int distinct = 0;
+
+    for (int joint = 1; joint <= 2 * NUM_CHANNELS; joint++) {
+        const struct pca9685_sim *chip = &bus->chips[(joint - 1) / NUM_CHANNELS];
+        int channel = (joint - 1) % NUM_CHANNELS + 1;
+        int on, off;
+        unsigned long latch;
+        pca9685_sim_get_output(chip, channel, &on, &off, &latch);
+        CHECK(on == frame->on[joint - 1] && off == frame->off[joint - 1],
+              "joint %d output %d/%d, want %d/%d", joint, on, off, frame->on[joint - 1],
+              frame->off[joint - 1]);
+
+        int seen = 0;
+        for (int i = 0; i < distinct; i++) {
+            seen |= events[i] == latch;
+        }
+        if (!seen) {
+            events[distinct++] = latch;
+        }
+    }
+    return distinct;
+}
+
+static void test_prescale(void)
+{
+    // 25 MHz / (4096 * 50 Hz) = 122.07 ticks per period
+    for (int c = 0; c < 2; c++) {
+        CHECK(bus->chips[c].regs[PRE_SCALE] == 121, "chip %d prescale %d, want 121", c,
+              bus->chips[c].regs[PRE_SCALE]);
+        float freq = pca9685_sim_get_freq(&bus->chips[c]);
+        CHECK(freq > 49.5f && freq < 50.5f, "chip %d runs at %.2f Hz", c, freq);
+    }
+    CHECK(LUT_REF_PRESCALE == 121, "LUT_REF_PRESCALE %d, want 121", LUT_REF_PRESCALE);
+}
+
+static void test_latch_on_stop(void)
+{
+    struct pwm_frame frame;
+
+    pwm_set_latch_mode(PWM_LATCH_STOP);
+    CHECK(!(bus->chips[0].regs[MODE2] & MODE2_OCH), "MODE2 OCH set in STOP mode");
+
+    stage_pose(&frame, 1000);
+    pca9685_sim_clear_log(bus);
+    pwm_frame_commit(&frame);
+    CHECK(check_outputs(&frame) == 1, "frame did not switch in one transition");
+
+    // one channel through the single register fallback
+    unsigned long before = bus->latch_events;
+    set_pwm(5, 0, 1500);
+    int on, off;
+    unsigned long latch;
+    pca9685_sim_get_output(&bus->chips[0], 5, &on, &off, &latch);
+    CHECK(off == 1500 && bus->latch_events == before + 1, "set_pwm took %lu latch events",
+          bus->latch_events - before);
+}
+
+/**
+ * @brief transactions of a register class since the last call, summed over the buses.
+ */
+static unsigned long transactions_since(enum pwm_reg_class reg_class, unsigned long *last)
+{
+    struct pwm_bus_stats stats;
+    pwm_stats_get(reg_class, &stats);
+    unsigned long delta = stats.transactions - *last;
+    *last = stats.transactions;
+    return delta;
+}
+
+/**
+ * @brief check that every output of both chips runs the given values.
+ */
+static void check_all_outputs(int want_on, int want_off)
+{
+    for (int joint = 1; joint <= 2 * NUM_CHANNELS; joint++) {
+        int on, off;
+        unsigned long latch;
+        pca9685_sim_get_output(&bus->chips[(joint - 1) / NUM_CHANNELS],
+                               (joint - 1) % NUM_CHANNELS + 1, &on, &off, &latch);
+        CHECK(on == want_on && off == want_off, "joint %d output %d/%d, want %d/%d", joint, on,
+              off, want_on, want_off);
+    }
+}
+
+static void test_broadcast(void)
+{
+    struct pwm_frame frame;
+    unsigned long all = 0, channel = 0;
+    transactions_since(PWM_REG_ALL, &all);
+    transactions_since(PWM_REG_CHANNEL, &channel);
+
+    // both chips on the bus: one ALL_LED message to the ALL_CALL address
+    pca9685_sim_clear_log(bus);
+    CHECK(pwm_set_all(0, 300) == 0, "pwm_set_all failed");
+    CHECK(bus->log_count == 1 && bus->log[0].addr == PCA9685_ALLCALL_ADDR
+              && bus->log[0].reg == ALLchannel_ON_L && bus->log[0].len == channel_MULTIPLIER,
+          "pwm_set_all sent %lu messages, first to 0x%02x reg 0x%02x", bus->log_count,
+          bus->log[0].addr, bus->log[0].reg);
+    CHECK(transactions_since(PWM_REG_ALL, &all) == 1, "pwm_set_all took more than one transaction");
+    check_all_outputs(0, 300);
+
+    // the shadow knows every channel now, repeating the values costs nothing
+    pca9685_sim_clear_log(bus);
+    pwm_set_all(0, 300);
+    pwm_frame_init(&frame);
+    for (int joint = 1; joint <= 2 * NUM_CHANNELS; joint++) {
+        pwm_frame_set(&frame, joint, 0, 300);
+    }
+    pwm_frame_commit(&frame);
+    CHECK(bus->log_count == 0, "unchanged values sent %lu messages", bus->log_count);
+    CHECK(transactions_since(PWM_REG_ALL, &all) == 0
+              && transactions_since(PWM_REG_CHANNEL, &channel) == 0,
+          "unchanged values were written");
+
+    // one chip uniform: an ALL_LED write to its own address, nothing to the other
+    pca9685_sim_clear_log(bus);
+    pwm_frame_init(&frame);
+    for (int joint = 1; joint <= NUM_CHANNELS; joint++) {
+        pwm_frame_set(&frame, joint, 0, 400);
+    }
+    pwm_frame_commit(&frame);
+    CHECK(bus->log_count == 1 && bus->log[0].addr == 0x40 && bus->log[0].reg == ALLchannel_ON_L,
+          "uniform chip sent %lu messages, first to 0x%02x reg 0x%02x", bus->log_count,
+          bus->log[0].addr, bus->log[0].reg);
+    CHECK(transactions_since(PWM_REG_ALL, &all) == 1, "uniform chip not one transaction");
+
+    // a channel differing from the rest keeps the chip off ALL_LED
+    pca9685_sim_clear_log(bus);
+    pwm_frame_init(&frame);
+    for (int joint = 1; joint <= NUM_CHANNELS; joint++) {
+        pwm_frame_set(&frame, joint, 0, joint == 13 ? 350 : 500);
+    }
+    pwm_frame_commit(&frame);
+    CHECK(bus->log_count == 1 && bus->log[0].reg == channel0_ON_L
+              && bus->log[0].len == NUM_CHANNELS * channel_MULTIPLIER,
+          "mixed chip sent %lu messages, first reg 0x%02x", bus->log_count, bus->log[0].reg);
+    CHECK(transactions_since(PWM_REG_CHANNEL, &channel) == 1
+              && transactions_since(PWM_REG_ALL, &all) == 0,
+          "mixed chip not one channel transaction");
+
+    // both chips uniform with the same value: one ALL_CALL message again
+    pca9685_sim_clear_log(bus);
+    pwm_frame_init(&frame);
+    for (int joint = 1; joint <= 2 * NUM_CHANNELS; joint++) {
+        pwm_frame_set(&frame, joint, 0, 600);
+    }
+    pwm_frame_commit(&frame);
+    CHECK(bus->log_count == 1 && bus->log[0].addr == PCA9685_ALLCALL_ADDR,
+          "uniform frame sent %lu messages, first to 0x%02x", bus->log_count, bus->log[0].addr);
+    check_all_outputs(0, 600);
+
+    pca9685_sim_clear_log(bus);
+    CHECK(pwm_all_off() == 0, "pwm_all_off failed");
+    CHECK(bus->log_count == 1 && bus->log[0].addr == PCA9685_ALLCALL_ADDR,
+          "pwm_all_off sent %lu messages", bus->log_count);
+    CHECK(transactions_since(PWM_REG_ALL, &all) == 2, "expected 2 ALL_LED transactions");
+    check_all_outputs(0, LED_FULL);
+}
+
+static void test_latch_on_ack(void)
+{
+    struct pwm_frame frame;
+
+    pwm_set_latch_mode(PWM_LATCH_ACK);
+    CHECK(bus->chips[1].regs[MODE2] & MODE2_OCH, "MODE2 OCH clear in ACK mode");
+
+    // channels update one by one, but never with half their registers written
+    stage_pose(&frame, 2000);
+    pwm_frame_commit(&frame);
+    CHECK(check_outputs(&frame) == 2 * NUM_CHANNELS, "expected one transition per channel");
+
+    pwm_set_latch_mode(PWM_LATCH_STOP);
+}
+
+int main(void)
+{
+    bus = pca9685_sim_get_bus();
+    pca9685_sim_add_chip(bus, 0x40);
+    pca9685_sim_add_chip(bus, 0x41);
+
+    pwm_set_transport(&pca9685_sim_transport);
+    int b = pwm_add_bus(I2C_DEVICE, &pca9685_sim_transport);
+    pwm_add_controller(b, 0x40);
+    pwm_add_controller(b, 0x41);
+    PCA9685_init();
+
+    test_prescale();
+    test_latch_on_stop();
+    test_latch_on_ack();
+    test_broadcast();
+
+    PCA9685_close();
+    printf("%s\n", failures ? "latch test FAILED" : "latch test passed");
+    return failures ? 1 : 0;
+}
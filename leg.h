@@ -49,6 +49,14 @@ typedef enum
     KIRI_DEPAN
 } LegPosition;
 
+// per leg constants in degrees: coxa zero offset of forward kinematics and orientation
+// offset of inverse kinematics, expanded into one kinematics kernel per leg in ik.c
+#define LEG_GEOMETRY(X)                                                                            \
+    X(KANAN_DEPAN, 0.0, 0.0)                                                                       \
+    X(KANAN_BELAKANG, 90.0, -90.0)                                                                 \
+    X(KIRI_BELAKANG, 180.0, -180.0)                                                                \
+    X(KIRI_DEPAN, 90.0, -270.0)
+
 extern SpiderLeg *legs[NUM_LEGS];
 extern LegPosition leg_positions[NUM_LEGS];
 extern float stance_angles[NUM_LEGS][3];
@@ -2,27 +2,60 @@
 #include "move.h"
 #include "pwm_servo.h"
 #include "interrupt.h"
+#include "servo_output.h"
 
+#include <signal.h>
 
+// set from the signal handler, the main loop exits and releases the bus
+static volatile sig_atomic_t exit_requested = 0;
+
+static void request_exit(int sig)
+{
+    (void)sig;
+    exit_requested = 1;
+}
 
 int main(void)
 {
     // Initialize PCA9685 if necessary
     PCA9685_init();
 
+    // servo pulse widths from calibrate_servo, defaults for channels it did not cover
+    struct CalibrationData calibration[MAX_JOINTS] = { 0 };
+    if (pwm_calibration_load(PWM_CALIBRATION_FILE, calibration, MAX_JOINTS) < 0) {
+        fprintf(stderr, "No %s, using default pulse widths\n", PWM_CALIBRATION_FILE);
+    }
+    pwm_lut_build(calibration, MAX_JOINTS);
+
     initialize_all_legs();
 
+    // dedicated thread sends pose frames on a fixed period
+    servo_output_start(SERVO_OUTPUT_RATE_HZ);
+
     // Set initial angles using forward kinematics
     stand_position();
 
     init_interrupt();
 
-    while (1) {
+    // Ctrl+C / kill leave the loop so the output thread and the bus are shut down cleanly
+    signal(SIGINT, request_exit);
+    signal(SIGTERM, request_exit);
+
+    int was_running = 0;
+    while (!exit_requested) {
         // Check if the switch is turned on
         if (is_program_running) {
             // If the switch is on, move forward
+            was_running = 1;
             move_forward();     
         } else {
+            // switch just turned off, report how the bus and output loop did
+            if (was_running) {
+                was_running = 0;
+                return_to_stance(STANCE_SPEED);
+                pwm_stats_dump(stdout);
+                servo_output_print_stats(stdout);
+            }
             stand_position();
             // If the switch is off, pause the program
             // You can add additional functionality here if needed
@@ -31,6 +64,11 @@ int main(void)
         }
     }
 
+    printf("exiting ...\n");
+    servo_output_stop();
+    // emergency stop: every output off in one write per bus, the servos go limp
+    pwm_all_off();
+    PCA9685_close();
 
     return 0;
 }
@@ -20,19 +20,14 @@ int main(void)
 {
     PCA9685_init();
 
-    
-    set_pwm_angle(SERVO_CHANNEL_1, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_2, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_3, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_4, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_5, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_6, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_7, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_8, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_9, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_10, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_11, 0, PWM_FREQ);
-    set_pwm_angle(SERVO_CHANNEL_12, 0, PWM_FREQ);
+    // start from every output off, one ALL_CALL write; the gripper stays limp
+    pwm_all_off();
+
+    // leg servos to 0 degrees for mounting the horns
+    struct pwm_frame frame;
+    pwm_frame_init(&frame);
+    pwm_frame_set_all_angle(&frame, PWM_CHANNEL_MASK(SERVO_CHANNEL_1, SERVO_CHANNEL_12), 0);
+    pwm_frame_commit(&frame);
 
     return 0;
 }
\ No newline at end of file
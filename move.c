@@ -1,13 +1,197 @@
+#define _DEFAULT_SOURCE
+#include <unistd.h>
 #include "move.h"
 
-void bezier2d_generate_straight_back(struct bezier2d *stright_back, float startx, float startz,
-                                     float endx, float endy)
+void set_angles(SpiderLeg *leg, float angles[3])
 {
-    bezier2d_addPoint(stright_back, startx, startz);
-    bezier2d_addPoint(stright_back, endx, endy);
+    leg->theta1 = normalize_angle(angles[0]);
+    leg->theta2 = normalize_angle(angles[1]);
+    leg->theta3 = normalize_angle(angles[2]);
+
+    for (int i = 0; i < 3; i++) {
+        set_pwm_angle_f(leg->servo_channles[i], angles[i]);
+        printf("theta%d: %.2f degrees\n", i + 1, angles[i]);
+    }
+}
+
+/**
+ * @brief send a planned move of count legs, one frame per control period.
+ *
+ * Stages the samples straight into the frame and keeps the legs' theta in step, without
+ * the per joint printing of set_angles().
+ */
+static void play_joint_trajectory(SpiderLeg *legs[], int count, struct joint_trajectory *traj)
+{
+    float angles[JOINT_TRAJECTORY_MAX_JOINTS];
+
+    while (joint_trajectory_next(traj, angles)) {
+        struct pwm_frame frame;
+        pwm_frame_init(&frame);
+        for (int i = 0; i < count; i++) {
+            const float *leg_angles = &angles[3 * i];
+            for (int k = 0; k < 3; k++) {
+                pwm_frame_set_angle_f(&frame, legs[i]->servo_channles[k], leg_angles[k]);
+            }
+            legs[i]->theta1 = leg_angles[0];
+            legs[i]->theta2 = leg_angles[1];
+            legs[i]->theta3 = leg_angles[2];
+        }
+        servo_output_submit(&frame);
+        // the output thread paces the frames, without it keep the control rate here
+        if (!servo_output_is_running()) {
+            usleep(1000000 / SERVO_OUTPUT_RATE_HZ);
+        }
+    }
+}
+
+/**
+ * @brief servo limits scaled by speed, a percentage clamped to 1..100.
+ *
+ * Velocity scales with speed and acceleration with its square, so a slower move keeps
+ * the shape of a full speed one.
+ */
+static void speed_limits(struct joint_limits *limits, int speed)
+{
+    float scale = fmaxf(1.0f, fminf((float)speed, 100.0f)) / 100.0f;
+    joint_limits_init(limits, JOINT_MAX_VELOCITY * scale, JOINT_MAX_ACCELERATION * scale * scale);
+}
+
+/**
+ * @brief move the joints of a leg to target_angles along a minimum jerk profile.
+ *
+ * The three joints start and finish together within the servo velocity and acceleration
+ * limits.
+ *
+ * @param leg leg to move, from its current angles.
+ * @param target_angles servo angles in degrees.
+ * @param speed percentage of the servo limits.
+ */
+void move_to_angle(SpiderLeg *leg, float target_angles[3], int speed)
+{
+    float current_angles[3] = { leg->theta1, leg->theta2, leg->theta3 };
+    struct joint_limits limits;
+    struct joint_trajectory traj;
+
+    speed_limits(&limits, speed);
+    joint_trajectory_plan(&traj, JOINT_PROFILE_MIN_JERK, 3, current_angles, target_angles, &limits,
+                          SERVO_OUTPUT_RATE_HZ);
+    play_joint_trajectory(&leg, 1, &traj);
+}
+
+/**
+ * @brief move the joints of several legs at once, see move_to_angle().
+ *
+ * Every joint of every leg starts and finishes together.
+ *
+ * @param legs legs to move, at most NUM_LEGS.
+ * @param target_angles servo angles of every leg in degrees.
+ * @param count number of legs.
+ * @param speed percentage of the servo limits.
+ */
+void move_to_angles(SpiderLeg *legs[], const float target_angles[][3], int count, int speed)
+{
+    float current_angles[JOINT_TRAJECTORY_MAX_JOINTS];
+    float goal[JOINT_TRAJECTORY_MAX_JOINTS];
+    struct joint_limits limits;
+    struct joint_trajectory traj;
+
+    if (count > NUM_LEGS) {
+        count = NUM_LEGS;
+    }
+    for (int i = 0; i < count; i++) {
+        current_angles[3 * i] = legs[i]->theta1;
+        current_angles[3 * i + 1] = legs[i]->theta2;
+        current_angles[3 * i + 2] = legs[i]->theta3;
+        memcpy(&goal[3 * i], target_angles[i], sizeof(target_angles[i]));
+    }
+    speed_limits(&limits, speed);
+    joint_trajectory_plan(&traj, JOINT_PROFILE_MIN_JERK, 3 * count, current_angles, goal, &limits,
+                          SERVO_OUTPUT_RATE_HZ);
+    play_joint_trajectory(legs, count, &traj);
+}
+
+/**
+ * @brief actuation stage: send solved angles to a leg's servos.
+ *
+ * @param leg leg to move.
+ * @param angles servo angles in degrees.
+ */
+void ik_apply(SpiderLeg *leg, float angles[3])
+{
+    set_angles(leg, angles);
+}
+
+/**
+ * @brief solve a foot target and move the leg there.
+ *
+ * ik_solve() followed by ik_apply() and a printed forward kinematics check. Targets
+ * out of the workspace are reported and leave the leg where it is.
+ *
+ * @param leg leg to move.
+ * @param target_positions foot position x, y, z.
+ * @param position_leg leg position.
+ */
+void inverse_kinematics(SpiderLeg *leg, const float target_positions[3], LegPosition position_leg)
+{
+    float angles[3];
+    if (ik_solve(target_positions, position_leg, angles) == IK_OUT_OF_WORKSPACE) {
+        fprintf(stderr, "%s: target (%.2f, %.2f, %.2f) out of reach\n", leg->name,
+                target_positions[0], target_positions[1], target_positions[2]);
+        return;
+    }
+    ik_apply(leg, angles);
+    forward_kinematics(leg, angles, position_leg);
+}
+
+/**
+ * @brief move several legs to their foot targets with one batch solve.
+ *
+ * Drop-in for calling inverse_kinematics() on each leg in turn: the angles are solved
+ * together, then applied and checked with forward kinematics per leg. Legs whose target
+ * is out of the workspace are reported and stay put.
+ *
+ * @param legs legs to move.
+ * @param targets foot target of every leg.
+ * @param positions position of every leg.
+ * @param count number of legs (at most NUM_LEGS).
+ */
+void inverse_kinematics_legs(SpiderLeg *legs[], const float targets[][3],
+                             const LegPosition positions[], int count)
+{
+    float x[NUM_LEGS] = { 0 }, y[NUM_LEGS] = { 0 }, z[NUM_LEGS] = { 0 };
+    float theta1[NUM_LEGS], theta2[NUM_LEGS], theta3[NUM_LEGS];
+    enum ik_status status[NUM_LEGS];
+
+    for (int i = 0; i < count; i++) {
+        x[i] = targets[i][0];
+        y[i] = targets[i][1];
+        z[i] = targets[i][2];
+    }
+    inverse_kinematics_batch(x, y, z, positions, count, theta1, theta2, theta3, status);
+
+    for (int i = 0; i < count; i++) {
+        if (status[i] == IK_OUT_OF_WORKSPACE) {
+            fprintf(stderr, "%s: target (%.2f, %.2f, %.2f) out of reach\n", legs[i]->name, x[i],
+                    y[i], z[i]);
+            continue;
+        }
+        float angles[3] = { theta1[i], theta2[i], theta3[i] };
+        ik_apply(legs[i], angles);
+        forward_kinematics(legs[i], angles, positions[i]);
+    }
+}
+
+int bezier2d_generate_straight_back(struct bezier2d *stright_back, float startx, float startz,
+                                    float endx, float endy)
+{
+    if (bezier2d_addPoint(stright_back, startx, startz) < 0 ||
+        bezier2d_addPoint(stright_back, endx, endy) < 0) {
+        return -1;
+    }
+    return 0;
 }
 
-void generate_stright_back_trajectory(struct bezier2d *stright_back, SpiderLeg *leg,
+int generate_stright_back_trajectory(struct bezier2d *stright_back, SpiderLeg *leg,
                                       float stride_length)
 {
     float startx = leg->joints[3][0];
@@ -17,11 +201,11 @@ void generate_stright_back_trajectory(struct bezier2d *stright_back, SpiderLeg *
     float endx = startx - stride_length / 2;
     float endz = startz;
 
-    bezier2d_generate_straight_back(stright_back, startx, startz, endx, endz);
+    return bezier2d_generate_straight_back(stright_back, startx, startz, endx, endz);
 }
 
-void generate_turn_left_trajectory(struct bezier3d *curve, SpiderLeg *leg, float stride_length,
-                                   float swing_height, LegPosition position_leg)
+int generate_turn_left_trajectory(struct bezier3d *curve, SpiderLeg *leg, float stride_length,
+                                  float swing_height, LegPosition position_leg)
 {
     // ambil posisi terkini pada 3d coordinate
     float startx = leg->joints[3][0];
@@ -37,27 +221,31 @@ void generate_turn_left_trajectory(struct bezier3d *curve, SpiderLeg *leg, float
     float endy = starty + stride_length;
     float endz = startz;
 
-    bezier3d_generate_curve(curve, startx, starty, startz, controlx, controly, controlz, endx, endy,
-                            endz);
+    return bezier3d_generate_curve(curve, startx, starty, startz, controlx, controly, controlz,
+                                   endx, endy, endz);
 }
 
 void print_trajectory(struct bezier2d *curve, int num_points)
 {
+    struct bezier2d_sampler sampler;
+    bezier2d_sampler_init(&sampler, curve, 0.0, 1.0 / num_points, 0);
+
     printf("Trajectory Points:\n");
     for (int i = 0; i <= num_points; i++) {
-        float t = (float)i / num_points;
         float x, y;
-        bezier2d_getPos(curve, t, &x, &y);
+        bezier2d_sampler_next(&sampler, &x, &y);
         printf("Point %d: (%.2f, %.2f)\n", i, x, y);
     }
 }
 
 void print_trajectory_3d(struct bezier3d *curve, int num_points) {
+    struct bezier3d_sampler sampler;
+    bezier3d_sampler_init(&sampler, curve, 0.0, 1.0 / num_points, 0);
+
     printf("Trajectory Points:\n");
     for (int i = 0; i <= num_points; i++) {
-        float t = (float)i / num_points;
         float x, y, z;
-        bezier3d_getpos(curve, t, &x, &y, &z);
+        bezier3d_sampler_next(&sampler, &x, &y, &z);
         printf("Point %d: (%.2f, %.2f, %.2f)\n", i, x, y, z);
     }
 }
@@ -71,10 +259,11 @@ void save_trajectory_points(struct bezier2d *curve, const char *filename, int nu
         return;
     }
 
+    struct bezier2d_sampler sampler;
+    bezier2d_sampler_init(&sampler, curve, 0.0, 1.0 / num_points, 0);
     for (int i = 0; i <= num_points; i++) {
-        float t = (float)i / num_points;
         float x, z;
-        bezier2d_getPos(curve, t, &x, &z);
+        bezier2d_sampler_next(&sampler, &x, &z);
         fprintf(file, "%.2f %.2f\n", x, z);
     }
 
@@ -87,18 +276,19 @@ void update_leg_wave_gait(struct bezier2d curve[NUM_LEGS], int num_points,
     float desired_duration = DESIRED_TIME;
     float dt = desired_duration / num_points;
 
-    for (int i = 0; i <= num_points; i++) {
-        float t = (float)i / num_points;
+    // every leg walks its curve from its phase offset, wrapping at the end of the cycle
+    struct bezier2d_sampler sampler[NUM_LEGS];
+    for (int j = 0; j < NUM_LEGS; j++) {
+        float phase_offset = (float)(j % 2) / (2.0f * NUM_LEGS); // Adjust for tripod stance
+        bezier2d_sampler_init(&sampler[j], &curve[j], phase_offset, 1.0 / num_points, 1);
+    }
 
+    for (int i = 0; i <= num_points; i++) {
         // Calculate positions for each leg based on the phase offsets
         float x[NUM_LEGS], z[NUM_LEGS];
-        // Declare phase_offsets here so it's accessible throughout the loop
-        float phase_offsets[NUM_LEGS];
         float phase_multiplier = 0.5;
         for (int j = 0; j < NUM_LEGS; j++) {
-            float phase_offset = t + (float)(j % 2) / (2.0f * NUM_LEGS); // Adjust for tripod stance
-            phase_offsets[j] = fmod(phase_offset, 1.0);
-            bezier2d_getPos(&curve[j], phase_offsets[j], &x[j], &z[j]);
+            bezier2d_sampler_next(&sampler[j], &x[j], &z[j]);
         }
 
         for (int j = 0; j < NUM_LEGS; j++) {
@@ -108,8 +298,12 @@ void update_leg_wave_gait(struct bezier2d curve[NUM_LEGS], int num_points,
         // Update leg positions using inverse kinematics
         for (int j = 0; j < NUM_LEGS; j++) {
             printf("------------------------------\n");
+            struct pwm_frame frame;
+            pwm_frame_init(&frame);
+            pwm_frame_begin(&frame);
             inverse_kinematics(legs[j], (float[]) { x[j], legs[j]->joints[3][1], z[j] },
                                leg_positions[j]);
+            servo_output_submit(&frame);
             printf("Leg Position: %s\n", leg_position_to_string(leg_positions[j]));
             usleep(10000);
         }
@@ -125,25 +319,38 @@ void update_leg_trot_gait(struct bezier2d curve[NUM_LEGS], int num_points,
     float desired_duration = DESIRED_TIME;
     float dt = desired_duration / num_points;
 
-    for (int i = 0; i <= num_points; i++) {
-        float t = (float)i / num_points;
-
-        // Define phase offsets for trot gait
-        float phase_offsets[NUM_LEGS] = { 0.0, 0.5, 0.0, 0.5 }; // Diagonal pairs
+    // Define phase offsets for trot gait
+    float phase_offsets[NUM_LEGS] = { 0.0, 0.5, 0.0, 0.5 }; // Diagonal pairs
+    struct bezier2d_sampler sampler[NUM_LEGS];
+    for (int j = 0; j < NUM_LEGS; j++) {
+        bezier2d_sampler_init(&sampler[j], &curve[j], phase_offsets[j], 1.0 / num_points, 1);
+    }
 
+    for (int i = 0; i <= num_points; i++) {
         // Calculate positions for each leg based on the phase offsets
         float x[NUM_LEGS], z[NUM_LEGS];
         for (int j = 0; j < NUM_LEGS; j++) {
-            float phase_offset = fmod(t + phase_offsets[j], 1.0);
-            bezier2d_getPos(&curve[j], phase_offset, &x[j], &z[j]);
+            bezier2d_sampler_next(&sampler[j], &x[j], &z[j]);
         }
 
-        // Update leg positions using inverse kinematics
+        float targets[NUM_LEGS][3];
         for (int j = 0; j < NUM_LEGS; j++) {
-            inverse_kinematics(legs[j], (float[]){ x[j], legs[j]->joints[3][1], z[j] }, leg_positions[j]);
+            targets[j][0] = x[j];
+            targets[j][1] = legs[j]->joints[3][1];
+            targets[j][2] = z[j];
         }
 
-        usleep((long)(dt * 1e6));
+        // Update leg positions using inverse kinematics, all joints land in one frame
+        struct pwm_frame frame;
+        pwm_frame_init(&frame);
+        pwm_frame_begin(&frame);
+        inverse_kinematics_legs(legs, targets, leg_positions, NUM_LEGS);
+        servo_output_submit(&frame);
+
+        // the output thread paces the loop when it runs
+        if (!servo_output_is_running()) {
+            usleep((long)(dt * 1e6));
+        }
     }
 }
 
@@ -156,23 +363,36 @@ void update_leg_left(struct bezier3d curve[NUM_LEGS], int num_points, SpiderLeg
     
     // Define the desired gait pattern for each leg (phase offsets)
     float phase_offsets[NUM_LEGS] = { 0.0, 0.25, 0.5, 0.75 }; // Example: Trot gait
+    struct bezier3d_sampler sampler[NUM_LEGS];
+    for (int j = 0; j < NUM_LEGS; j++) {
+        bezier3d_sampler_init(&sampler[j], &curve[j], phase_offsets[j], 1.0 / num_points, 1);
+    }
     
     for (int i = 0; i <= num_points; i++) {
-        float t = (float)i / num_points;
-
         // Update positions for each leg based on the gait pattern
         float x[NUM_LEGS], y[NUM_LEGS], z[NUM_LEGS];
         for (int j = 0; j < NUM_LEGS; j++) {
-            float phase_offset = fmod(t + phase_offsets[j], 1.0);
-            bezier3d_getpos(&curve[j], phase_offset, &x[j], &y[j], &z[j]);
+            bezier3d_sampler_next(&sampler[j], &x[j], &y[j], &z[j]);
         }
 
-        // Update leg positions using inverse kinematics
+        float targets[NUM_LEGS][3];
         for (int j = 0; j < NUM_LEGS; j++) {
-            inverse_kinematics(legs[j], (float[]){ x[j], y[j], z[j] }, leg_positions[j]);
+            targets[j][0] = x[j];
+            targets[j][1] = y[j];
+            targets[j][2] = z[j];
         }
 
-        usleep((long)(dt * 1e6));
+        // Update leg positions using inverse kinematics, all joints land in one frame
+        struct pwm_frame frame;
+        pwm_frame_init(&frame);
+        pwm_frame_begin(&frame);
+        inverse_kinematics_legs(legs, targets, leg_positions, NUM_LEGS);
+        servo_output_submit(&frame);
+
+        // the output thread paces the loop when it runs
+        if (!servo_output_is_running()) {
+            usleep((long)(dt * 1e6));
+        }
     }
 }
 
@@ -195,40 +415,67 @@ const char *leg_position_to_string(LegPosition position)
 
 void stand_position(void)
 {
+    struct pwm_frame frame;
+    pwm_frame_init(&frame);
+    pwm_frame_begin(&frame);
     for (int i = 0; i < NUM_LEGS; i++) {
         printf("standby position for Leg %s (Position %d):\n", legs[i]->name, leg_positions[i]);
         set_angles(legs[i], stance_angles[i]);
         forward_kinematics(legs[i], stance_angles[i], leg_positions[i]);
         printf("----------------------------\n");
     }
+    servo_output_submit(&frame);
 }
 
-void move_forward(void)
+/**
+ * @brief settle every leg back into the stance along one planned move.
+ *
+ * Starts from the angles the legs were last driven to, e.g. a gait stopped mid cycle,
+ * so the servos are not stepped to the stance in a single frame.
+ *
+ * @param speed percentage of the servo limits.
+ */
+void return_to_stance(int speed)
 {
-    struct bezier2d curve[NUM_LEGS];
+    move_to_angles(legs, (const float (*)[3])stance_angles, NUM_LEGS, speed);
     for (int i = 0; i < NUM_LEGS; i++) {
-        bezier2d_init(&curve[i]);
-        if (leg_positions[i] == KANAN_BELAKANG || leg_positions[i] == KIRI_BELAKANG) {
-            generate_walk_back_leg_trajectory(&curve[i], legs[i], STRIDE_LENGTH, SWING_HEIGHT,
-                                   leg_positions[i]);
-        } else {
-            generate_walk_trajectory(&curve[i], legs[i], STRIDE_LENGTH, SWING_HEIGHT,
-                                     leg_positions[i]);
-        }
+        forward_kinematics(legs[i], stance_angles[i], leg_positions[i]);
+    }
+}
+
+void move_forward(void)
+{
+    // the trot cycle is compiled once from the stance and then only replayed
+    static struct gait_table trot;
+    static int trot_ready;
+    const float phase_offsets[NUM_LEGS] = { 0.0, 0.5, 0.0, 0.5 }; // Diagonal pairs
+
+    if (!trot_ready) {
+        gait_table_init(&trot, legs, leg_positions, phase_offsets, STRIDE_LENGTH, SWING_HEIGHT,
+                        NUM_POINTS);
+        trot_ready = 1;
     }
 
     while (is_program_running) {
-        update_leg_trot_gait(curve, NUM_POINTS, legs, leg_positions);
+        gait_table_play(&trot, DESIRED_TIME);
         usleep(100);
     }
 }
 
 void move_left_turn(void)
 {
+    // the turn curves of one gait generation, released together when the next one starts
+    static float turn_storage[NUM_LEGS * 4 * BEZIER3D_STRIDE];
+    static struct bezier_arena turn_arena = { turn_storage, NUM_LEGS * 4 * BEZIER3D_STRIDE, 0 };
     struct bezier3d curve[NUM_LEGS];
+
+    bezier_arena_reset(&turn_arena);
     for(int i = 0; i < NUM_LEGS; i++) {
-        bezier3d_init(&curve[i]);
-        generate_turn_left_trajectory(&curve[i], legs[i], STRIDE_LENGTH, SWING_HEIGHT, leg_positions[i]);
+        bezier3d_init_arena(&curve[i], &turn_arena);
+        if (generate_turn_left_trajectory(&curve[i], legs[i], STRIDE_LENGTH, SWING_HEIGHT,
+                                          leg_positions[i]) < 0) {
+            return;
+        }
         print_trajectory_3d(&curve[i], NUM_POINTS);
     }
     
@@ -269,9 +516,13 @@ void self_balance(float roll, float pitch)
         adjust_leg_positions(pitch, roll, legs);
 
         // Update leg positions with adjusted angles
+        struct pwm_frame frame;
+        pwm_frame_init(&frame);
+        pwm_frame_begin(&frame);
         for (int i = 0; i < NUM_LEGS; i++) {
             set_angles(legs[i], (float[]){ legs[i]->theta1, legs[i]->theta2, legs[i]->theta3 });
         }
+        servo_output_submit(&frame);
 
         // Add delay before next iteration to control loop frequency
         usleep(100000); // Adjust as needed based on desired loop frequency
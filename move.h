@@ -1,13 +1,16 @@
 #ifndef MOVE_H
 #define MOVE_H
 
-#include "gsl/gsl_spline.h"
 #include "ik.h"
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
+#include "gait.h"
 #include "interrupt.h"
+#include "joint_trajectory.h"
+#include "pwm_servo.h"
+#include "servo_output.h"
 #include "trajectory.h"
 
 typedef enum
@@ -38,6 +41,7 @@ struct LegThreadData
 #define NUM_PHASES 2
 #define FORWARD_DISPLACEMENT 0.01 
 #define LEG_HEIGHT_OFFSET 20.0
+#define STANCE_SPEED 30 // percent of the servo limits when settling back into the stance
 
 #define PHASE_OFFSET_1 0.0 // Phase offset for leg 1
 #define PHASE_OFFSET_2 0.25 // Phase offset for leg 2
@@ -49,10 +53,19 @@ struct LegThreadData
 #define ROLL_THRESHOLD 5.0   // Threshold for roll deviation (degrees)
 #define LEG_ADJUSTMENT_ANGLE 2.0  // Angle to adjust leg position (degrees)
 
-void generate_stright_back_trajectory(struct bezier2d *stright_back, SpiderLeg *leg,
-                                      float stride_length);
-void generate_turn_left_trajectory(struct bezier3d *curve, SpiderLeg *leg, float stride_length,
-                                   float swing_height, LegPosition position_leg);
+// actuation: solved angles to the servos
+void set_angles(SpiderLeg *leg, float angles[3]);
+void ik_apply(SpiderLeg *leg, float angles[3]);
+void inverse_kinematics(SpiderLeg *leg, const float target_positions[3], LegPosition position_leg);
+void inverse_kinematics_legs(SpiderLeg *legs[], const float targets[][3],
+                             const LegPosition positions[], int count);
+void move_to_angle(SpiderLeg *leg, float target_angles[3], int speed);
+void move_to_angles(SpiderLeg *legs[], const float target_angles[][3], int count, int speed);
+
+int generate_stright_back_trajectory(struct bezier2d *stright_back, SpiderLeg *leg,
+                                     float stride_length);
+int generate_turn_left_trajectory(struct bezier3d *curve, SpiderLeg *leg, float stride_length,
+                                  float swing_height, LegPosition position_leg);
 
 // printing and saving//
 void print_trajectory(struct bezier2d *curve, int num_points);
@@ -78,6 +91,7 @@ void *move_leg(void *thread_data);
 
 // movement relative function
 void stand_position(void);
+void return_to_stance(int speed);
 void move_forward(void);
 void move_left_turn(void);
 #endif // MOVE_H
\ No newline at end of file
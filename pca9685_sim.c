@@ -0,0 +1,354 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <string.h>
+#include "pca9685_sim.h"
+
+#define LAST_CHANNEL_REG (channel0_ON_L + MAX_BURST_LEN - 1) // LED15_OFF_H
+
+static int sim_open(struct pwm_transport *t, const char *device);
+static void sim_close(struct pwm_transport *t);
+static int sim_transfer(struct pwm_transport *t, struct i2c_msg *msgs, int nmsgs);
+static int sim_run_msgs(struct pca9685_sim_bus *bus, struct i2c_msg *msgs, int nmsgs);
+
+static struct pca9685_sim_bus sim_bus;
+
+struct pwm_transport pca9685_sim_transport = {
+    .name = "sim",
+    .open = sim_open,
+    .close = sim_close,
+    .transfer = sim_transfer,
+    .fd = -1,
+    .priv = &sim_bus,
+};
+
+/**
+ * @brief bus behind pca9685_sim_transport.
+ */
+struct pca9685_sim_bus *pca9685_sim_get_bus(void)
+{
+    return &sim_bus;
+}
+
+/**
+ * @brief load the power-on register values of a PCA9685.
+ *
+ * @param chip simulated chip.
+ */
+void pca9685_sim_reset(struct pca9685_sim *chip)
+{
+    memset(chip->regs, 0, sizeof(chip->regs));
+    chip->regs[MODE1] = MODE1_SLEEP | MODE1_ALLCALL;
+    chip->regs[MODE2] = 0x04;
+    chip->regs[SUBADR1] = 0xE2;
+    chip->regs[SUBADR2] = 0xE4;
+    chip->regs[SUBADR3] = 0xE8;
+    chip->regs[ALLCALLADR] = 0xE0;
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+        chip->regs[channel0_OFF_H + channel_MULTIPLIER * i] = LED_FULL >> 8;
+    }
+    chip->regs[PRE_SCALE] = 0x1E;
+    chip->ptr = 0;
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+        chip->out_on[i] = 0;
+        chip->out_off[i] = LED_FULL;
+        chip->out_latch[i] = 0;
+    }
+}
+
+/**
+ * @brief attach a simulated chip to a bus.
+ *
+ * @param bus simulated bus.
+ * @param addr 7-bit address.
+ * @return the chip, or NULL when the bus is full.
+ */
+struct pca9685_sim *pca9685_sim_add_chip(struct pca9685_sim_bus *bus, uint8_t addr)
+{
+    struct pca9685_sim *chip = pca9685_sim_find_chip(bus, addr);
+    if (chip) {
+        return chip;
+    }
+    if (bus->nchips >= SIM_MAX_CHIPS) {
+        return NULL;
+    }
+    chip = &bus->chips[bus->nchips++];
+    chip->addr = addr;
+    pca9685_sim_reset(chip);
+    return chip;
+}
+
+/**
+ * @brief look up a chip by its own address.
+ */
+struct pca9685_sim *pca9685_sim_find_chip(struct pca9685_sim_bus *bus, uint8_t addr)
+{
+    for (int i = 0; i < bus->nchips; i++) {
+        if (bus->chips[i].addr == addr) {
+            return &bus->chips[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief drop the recorded transactions and the bus time estimate.
+ */
+void pca9685_sim_clear_log(struct pca9685_sim_bus *bus)
+{
+    bus->log_count = 0;
+    bus->bus_ns = 0;
+}
+
+/**
+ * @brief read back the ON/OFF registers of a channel.
+ *
+ * @param chip simulated chip.
+ * @param channel channel number (1 - NUM_CHANNELS).
+ * @param on_value ON value out.
+ * @param off_value OFF value out.
+ * @return 0 on success, -1 for a bad channel.
+ */
+int pca9685_sim_get_channel(const struct pca9685_sim *chip, uint8_t channel, int *on_value,
+                            int *off_value)
+{
+    if (channel < 1 || channel > NUM_CHANNELS) {
+        return -1;
+    }
+    const uint8_t *reg = &chip->regs[channel0_ON_L + channel_MULTIPLIER * (channel - 1)];
+    *on_value = reg[0] | (reg[1] << 8);
+    *off_value = reg[2] | (reg[3] << 8);
+    return 0;
+}
+
+/**
+ * @brief ON/OFF values a channel output is running with.
+ *
+ * Differs from pca9685_sim_get_channel() between a register write and the STOP (or
+ * ACK, with MODE2 OCH set) that latches it.
+ *
+ * @param chip simulated chip.
+ * @param channel channel number (1 - NUM_CHANNELS).
+ * @param on_value ON value out.
+ * @param off_value OFF value out.
+ * @param latch latch event that last changed the output out, NULL if not needed.
+ * @return 0 on success, -1 for a bad channel.
+ */
+int pca9685_sim_get_output(const struct pca9685_sim *chip, uint8_t channel, int *on_value,
+                           int *off_value, unsigned long *latch)
+{
+    if (channel < 1 || channel > NUM_CHANNELS) {
+        return -1;
+    }
+    *on_value = chip->out_on[channel - 1];
+    *off_value = chip->out_off[channel - 1];
+    if (latch) {
+        *latch = chip->out_latch[channel - 1];
+    }
+    return 0;
+}
+
+/**
+ * @brief PWM frequency produced by the current prescaler.
+ */
+float pca9685_sim_get_freq(const struct pca9685_sim *chip)
+{
+    return CLOCK_FREQ / (4096.0 * (chip->regs[PRE_SCALE] + 1));
+}
+
+/**
+ * @brief does the chip answer to this address (own address or enabled ALLCALL).
+ */
+static int sim_responds(const struct pca9685_sim *chip, uint16_t addr)
+{
+    if (chip->addr == addr) {
+        return 1;
+    }
+    return (chip->regs[MODE1] & MODE1_ALLCALL) && (chip->regs[ALLCALLADR] >> 1) == addr;
+}
+
+/**
+ * @brief copy the channel registers selected by mask to the outputs.
+ *
+ * @param chip simulated chip.
+ * @param mask bit n: channel n+1.
+ * @param event latch event number recorded for changed outputs.
+ */
+static void sim_latch(struct pca9685_sim *chip, uint16_t mask, unsigned long event)
+{
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        const uint8_t *reg = &chip->regs[channel0_ON_L + channel_MULTIPLIER * i];
+        uint16_t on_value = reg[0] | (reg[1] << 8);
+        uint16_t off_value = reg[2] | (reg[3] << 8);
+        if (on_value != chip->out_on[i] || off_value != chip->out_off[i]) {
+            chip->out_on[i] = on_value;
+            chip->out_off[i] = off_value;
+            chip->out_latch[i] = event;
+        }
+    }
+}
+
+/**
+ * @brief advance the register pointer after a data byte.
+ */
+static void sim_next_reg(struct pca9685_sim *chip)
+{
+    if (!(chip->regs[MODE1] & MODE1_AI)) {
+        return;
+    }
+    if (chip->ptr == LAST_CHANNEL_REG) {
+        chip->ptr = MODE1; // auto-increment rolls over after LED15_OFF_H
+    } else {
+        chip->ptr++;
+    }
+}
+
+/**
+ * @brief store one data byte at the register pointer.
+ *
+ * With MODE2 OCH set the outputs follow on the ACK of a channel's OFF_H byte, so all
+ * four registers of a channel take effect together but channels change one by one.
+ */
+static void sim_write_reg(struct pca9685_sim_bus *bus, struct pca9685_sim *chip, uint8_t val)
+{
+    uint8_t reg = chip->ptr;
+
+    if (reg == MODE1) {
+        // restart is an action, the bit reads back as 0 once it has run
+        chip->regs[MODE1] = val & ~MODE1_RESTART;
+    } else if (reg == PRE_SCALE) {
+        // the prescaler only latches while the oscillator is off
+        if (chip->regs[MODE1] & MODE1_SLEEP) {
+            chip->regs[PRE_SCALE] = val;
+        }
+    } else if (reg >= ALLchannel_ON_L && reg <= ALLchannel_OFF_H) {
+        for (int i = 0; i < NUM_CHANNELS; i++) {
+            chip->regs[channel0_ON_L + channel_MULTIPLIER * i + (reg - ALLchannel_ON_L)] = val;
+        }
+    } else if (reg < 0xF0 && reg > LAST_CHANNEL_REG) {
+        // reserved registers ignore writes
+    } else {
+        chip->regs[reg] = val;
+    }
+
+    if (chip->regs[MODE2] & MODE2_OCH) {
+        if (reg == ALLchannel_OFF_H) {
+            sim_latch(chip, 0xFFFF, ++bus->latch_events);
+        } else if (reg >= channel0_ON_L && reg <= LAST_CHANNEL_REG
+                   && (reg - channel0_ON_L) % channel_MULTIPLIER == channel_MULTIPLIER - 1) {
+            sim_latch(chip, 1u << ((reg - channel0_ON_L) / channel_MULTIPLIER),
+                      ++bus->latch_events);
+        }
+    }
+    sim_next_reg(chip);
+}
+
+/**
+ * @brief one byte at the register pointer, ALL_LED registers read back as 0.
+ */
+static uint8_t sim_read_reg(struct pca9685_sim *chip)
+{
+    uint8_t reg = chip->ptr;
+    uint8_t val = (reg >= ALLchannel_ON_L && reg <= ALLchannel_OFF_H) ? 0 : chip->regs[reg];
+    sim_next_reg(chip);
+    return val;
+}
+
+/**
+ * @brief append a message to the transaction log.
+ */
+static void sim_log(struct pca9685_sim_bus *bus, const struct i2c_msg *msg, uint8_t reg)
+{
+    struct pca9685_sim_txn *txn = &bus->log[bus->log_count % SIM_LOG_SIZE];
+    clock_gettime(CLOCK_MONOTONIC, &txn->ts);
+    txn->addr = msg->addr;
+    txn->flags = msg->flags;
+    txn->reg = reg;
+    txn->len = ((msg->flags & I2C_M_RD) || msg->len == 0) ? msg->len : msg->len - 1;
+    bus->log_count++;
+    // start/address byte plus payload, 9 clocks per byte
+    bus->bus_ns += (unsigned long)(msg->len + 1) * 9 * 1000000000UL / SIM_BUS_HZ;
+}
+
+static int sim_open(struct pwm_transport *t, const char *device)
+{
+    (void)device;
+    struct pca9685_sim_bus *bus = t->priv;
+    if (bus->nchips == 0) {
+        pca9685_sim_add_chip(bus, PCA9685_SLAVE_ADDR);
+    }
+    return 0;
+}
+
+static void sim_close(struct pwm_transport *t)
+{
+    (void)t;
+}
+
+/**
+ * @brief run a combined transaction against every chip that answers each message.
+ *
+ * A write message sets the register pointer from its first byte and stores the rest;
+ * a read message returns bytes from the pointer left by the previous message. The
+ * whole transfer fails with ENXIO when nobody acknowledges an address. Messages are
+ * joined by repeated STARTs, so chips changing outputs on STOP latch everything written
+ * in the transfer at once, at its end.
+ *
+ * @return number of messages transferred, -1 on error.
+ */
+static int sim_transfer(struct pwm_transport *t, struct i2c_msg *msgs, int nmsgs)
+{
+    struct pca9685_sim_bus *bus = t->priv;
+    int ret = sim_run_msgs(bus, msgs, nmsgs);
+
+    // STOP, seen by every chip on the bus
+    unsigned long event = ++bus->latch_events;
+    for (int c = 0; c < bus->nchips; c++) {
+        if (!(bus->chips[c].regs[MODE2] & MODE2_OCH)) {
+            sim_latch(&bus->chips[c], 0xFFFF, event);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief run the messages of a transfer up to the STOP.
+ *
+ * @return number of messages transferred, -1 on error.
+ */
+static int sim_run_msgs(struct pca9685_sim_bus *bus, struct i2c_msg *msgs, int nmsgs)
+{
+    for (int m = 0; m < nmsgs; m++) {
+        struct i2c_msg *msg = &msgs[m];
+        int acked = 0;
+        uint8_t start_reg = 0;
+
+        for (int c = 0; c < bus->nchips; c++) {
+            struct pca9685_sim *chip = &bus->chips[c];
+            if (!sim_responds(chip, msg->addr)) {
+                continue;
+            }
+            if (msg->flags & I2C_M_RD) {
+                // reads are only valid from a single chip
+                start_reg = chip->ptr;
+                for (int i = 0; i < msg->len; i++) {
+                    msg->buf[i] = sim_read_reg(chip);
+                }
+            } else if (msg->len > 0) {
+                chip->ptr = start_reg = msg->buf[0];
+                for (int i = 1; i < msg->len; i++) {
+                    sim_write_reg(bus, chip, msg->buf[i]);
+                }
+            }
+            acked = 1;
+        }
+        if (!acked) {
+            errno = ENXIO;
+            return -1;
+        }
+        sim_log(bus, msg, start_reg);
+    }
+    return nmsgs;
+}
@@ -0,0 +1,58 @@
+#ifndef PCA9685_SIM_H
+#define PCA9685_SIM_H
+
+#include <stdint.h>
+#include <time.h>
+#include "pwm_servo.h"
+
+#define SIM_MAX_CHIPS 4 // simulated PCA9685s per bus
+#define SIM_LOG_SIZE 4096 // transactions kept in the log ring
+#define SIM_BUS_HZ 400000 // bus clock used for the transfer time estimate
+
+/* one register access as seen on the simulated bus */
+struct pca9685_sim_txn
+{
+    struct timespec ts; // CLOCK_MONOTONIC when the transaction was issued
+    uint16_t addr;
+    uint16_t flags; // I2C_M_RD for reads
+    uint8_t reg; // register pointer at the start of the message
+    uint16_t len; // data bytes, register pointer byte excluded
+};
+
+/* register model of one PCA9685 */
+struct pca9685_sim
+{
+    uint8_t addr;
+    uint8_t regs[256];
+    uint8_t ptr; // control register (register pointer)
+    uint16_t out_on[NUM_CHANNELS]; // ON/OFF values the outputs run with, latched from regs
+    uint16_t out_off[NUM_CHANNELS];
+    unsigned long out_latch[NUM_CHANNELS]; // latch event that last changed the output
+};
+
+/* a bus with one or more simulated chips, the priv data of pca9685_sim_transport */
+struct pca9685_sim_bus
+{
+    struct pca9685_sim chips[SIM_MAX_CHIPS];
+    int nchips;
+    struct pca9685_sim_txn log[SIM_LOG_SIZE];
+    unsigned long log_count; // total transactions, log[log_count % SIM_LOG_SIZE] is next
+    unsigned long bus_ns; // estimated time the transfers would take on the wire
+    unsigned long latch_events; // output updates so far, on STOP or on ACK per MODE2 OCH
+};
+
+extern struct pwm_transport pca9685_sim_transport;
+
+struct pca9685_sim_bus *pca9685_sim_get_bus(void);
+struct pca9685_sim *pca9685_sim_add_chip(struct pca9685_sim_bus *bus, uint8_t addr);
+struct pca9685_sim *pca9685_sim_find_chip(struct pca9685_sim_bus *bus, uint8_t addr);
+void pca9685_sim_reset(struct pca9685_sim *chip);
+void pca9685_sim_clear_log(struct pca9685_sim_bus *bus);
+
+int pca9685_sim_get_channel(const struct pca9685_sim *chip, uint8_t channel, int *on_value,
+                            int *off_value);
+int pca9685_sim_get_output(const struct pca9685_sim *chip, uint8_t channel, int *on_value,
+                           int *off_value, unsigned long *latch);
+float pca9685_sim_get_freq(const struct pca9685_sim *chip);
+
+#endif // PCA9685_SIM_H
@@ -1,81 +1,853 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
 #include "pwm_servo.h"
+#include "pca9685_sim.h"
 
-int i2c_fd;
+static int i2cdev_open(struct pwm_transport *t, const char *device);
+static void i2cdev_close(struct pwm_transport *t);
+static int i2cdev_transfer(struct pwm_transport *t, struct i2c_msg *msgs, int nmsgs);
+
+struct pwm_transport pwm_transport_i2cdev = {
+    .name = "i2c-dev",
+    .open = i2cdev_open,
+    .close = i2cdev_close,
+    .transfer = i2cdev_transfer,
+    .fd = -1,
+    .priv = NULL,
+};
+
+// backend for the default bus, chosen in PCA9685_init() unless set before
+static struct pwm_transport *default_transport;
+
+// buses and controllers, filled by pwm_add_bus()/pwm_add_controller() or PCA9685_init()
+static struct pwm_bus buses[MAX_BUSES];
+static int num_buses;
+static struct pca9685 controllers[MAX_CONTROLLERS];
+static int num_controllers;
+// logical channel n+1 -> controller/channel
+static struct pwm_joint joint_map[MAX_JOINTS];
+static int joint_map_ready;
+
+/* how the staged channels of one controller are sent by bus_flush() */
+struct flush_plan
+{
+    int use_all; // ALL_LED write of all_on/all_off first
+    uint16_t all_on;
+    uint16_t all_off;
+    uint16_t patch; // channels written one run at a time
+};
+
+// when written channel values reach the outputs, see pwm_set_latch_mode()
+static enum pwm_latch_mode latch_mode = PWM_LATCH_STOP;
+
+static const char *const reg_class_names[PWM_REG_CLASSES] = { "mode", "channel", "all",
+                                                              "prescale" };
+
+// per logical channel pulse widths, 0 entries fall back to MIN/MAX_PULSE_WIDTH
+static struct CalibrationData calibration[MAX_JOINTS];
+// OFF ticks per whole degree in LUT_FRAC_BITS fixed point, built by pwm_lut_build()
+static uint16_t angle_lut[MAX_JOINTS][ANGLE_RANGE + 1];
+// frame collecting channel writes between pwm_frame_begin() and pwm_frame_commit(),
+// per thread so a planner can capture while the output thread commits
+static _Thread_local struct pwm_frame *capture;
+
+static int i2cdev_open(struct pwm_transport *t, const char *device)
+{
+    t->fd = open(device, O_RDWR);
+    if (t->fd < 0) {
+        perror("Faichannel to open the i2c device");
+        return -1;
+    }
+    return 0;
+}
+
+static void i2cdev_close(struct pwm_transport *t)
+{
+    if (t->fd >= 0) {
+        close(t->fd);
+        t->fd = -1;
+    }
+}
+
+static int i2cdev_transfer(struct pwm_transport *t, struct i2c_msg *msgs, int nmsgs)
+{
+    struct i2c_rdwr_ioctl_data data;
+    data.msgs = msgs;
+    data.nmsgs = nmsgs;
+    return ioctl(t->fd, I2C_RDWR, &data);
+}
 
 /**
- * @brief Initialize the PCA9685 module i2c
+ * @brief select the backend of the default bus, call before PCA9685_init().
+ *
+ * @param t transport, e.g. &pwm_transport_i2cdev or &pca9685_sim_transport.
  */
-void PCA9685_init()
+void pwm_set_transport(struct pwm_transport *t)
 {
-    i2c_fd = open(I2C_DEVICE, O_RDWR);
-    if (i2c_fd < 0) {
-        perror("Faichannel to open the i2c device");
+    default_transport = t;
+}
+
+/**
+ * @brief the backend of the first bus.
+ */
+struct pwm_transport *pwm_get_transport(void)
+{
+    return num_buses > 0 ? &buses[0].transport : default_transport;
+}
+
+/**
+ * @brief register an I2C bus, call before PCA9685_init().
+ *
+ * The transport is copied, so one backend can serve several buses; give each copy its
+ * own priv data where the backend keeps per-bus state (e.g. a pca9685_sim_bus).
+ *
+ * @param device device node, e.g. "/dev/i2c-2".
+ * @param transport backend template.
+ * @return bus index, -1 when all MAX_BUSES are taken.
+ */
+int pwm_add_bus(const char *device, const struct pwm_transport *transport)
+{
+    if (num_buses >= MAX_BUSES) {
+        fprintf(stderr, "Too many i2c buses\n");
+        return -1;
+    }
+    struct pwm_bus *bus = &buses[num_buses];
+    memset(bus, 0, sizeof(*bus));
+    snprintf(bus->device, sizeof(bus->device), "%s", device);
+    bus->transport = *transport;
+    bus->transport.fd = -1;
+    pthread_mutex_init(&bus->lock, NULL);
+    pthread_cond_init(&bus->cond, NULL);
+    return num_buses++;
+}
+
+/**
+ * @brief register a PCA9685 on a bus, call before PCA9685_init().
+ *
+ * @param bus bus index from pwm_add_bus().
+ * @param addr 7-bit I2C address.
+ * @return controller index, -1 on error.
+ */
+int pwm_add_controller(int bus, uint8_t addr)
+{
+    if (bus < 0 || bus >= num_buses || num_controllers >= MAX_CONTROLLERS) {
+        fprintf(stderr, "Cannot add controller 0x%02x on bus %d\n", addr, bus);
+        return -1;
+    }
+    struct pca9685 *ctrl = &controllers[num_controllers];
+    memset(ctrl, 0, sizeof(*ctrl));
+    ctrl->bus = &buses[bus];
+    ctrl->addr = addr;
+    return num_controllers++;
+}
+
+/**
+ * @brief map a logical channel to a controller output.
+ *
+ * Logical channels left unmapped at PCA9685_init() follow the controllers in order:
+ * 1-16 on controller 0, 17-32 on controller 1, and so on.
+ *
+ * @param joint logical channel (1 - MAX_JOINTS).
+ * @param controller controller index.
+ * @param channel output on that controller (1 - NUM_CHANNELS).
+ * @return 0 on success, -1 on a bad argument.
+ */
+int pwm_map_joint(uint8_t joint, int controller, uint8_t channel)
+{
+    if (joint < 1 || joint > MAX_JOINTS || controller < 0 || controller >= num_controllers
+        || channel < 1 || channel > NUM_CHANNELS) {
+        fprintf(stderr, "Bad joint map %d -> %d/%d\n", joint, controller, channel);
+        return -1;
+    }
+    if (!joint_map_ready) {
+        for (int i = 0; i < MAX_JOINTS; i++) {
+            joint_map[i].controller = -1;
+        }
+        joint_map_ready = 1;
+    }
+    joint_map[joint - 1].controller = controller;
+    joint_map[joint - 1].channel = channel;
+    return 0;
+}
+
+int pwm_num_controllers(void)
+{
+    return num_controllers;
+}
+
+struct pca9685 *pwm_get_controller(int index)
+{
+    return (index >= 0 && index < num_controllers) ? &controllers[index] : NULL;
+}
+
+/**
+ * @brief controller and channel behind a logical channel.
+ *
+ * @param joint logical channel.
+ * @param channel channel on the controller, out.
+ * @return controller, NULL when unmapped.
+ */
+static struct pca9685 *joint_controller(uint8_t joint, int *channel)
+{
+    if (joint < 1 || joint > MAX_JOINTS || joint_map[joint - 1].controller < 0) {
+        return NULL;
+    }
+    *channel = joint_map[joint - 1].channel;
+    return &controllers[joint_map[joint - 1].controller];
+}
+
+/**
+ * @brief register class of a transaction, taken from the register it starts at.
+ */
+static enum pwm_reg_class reg_class_of(uint8_t reg)
+{
+    if (reg == PRE_SCALE) {
+        return PWM_REG_PRESCALE;
+    }
+    if (reg >= ALLchannel_ON_L && reg <= ALLchannel_OFF_H) {
+        return PWM_REG_ALL;
+    }
+    if (reg >= channel0_ON_L) {
+        return PWM_REG_CHANNEL;
+    }
+    return PWM_REG_MODE;
+}
+
+/**
+ * @brief histogram bucket of a latency, log2 of whole microseconds.
+ */
+static int latency_bucket(unsigned long ns)
+{
+    unsigned long us = ns / 1000;
+    if (us == 0) {
+        return 0;
+    }
+    int bucket = (int)(sizeof(unsigned long) * 8) - __builtin_clzl(us);
+    return bucket < PWM_STATS_BUCKETS ? bucket : PWM_STATS_BUCKETS - 1;
+}
+
+#define COUNTER_LOAD(c) atomic_load_explicit(&(c), memory_order_relaxed)
+#define COUNTER_STORE(c, v) atomic_store_explicit(&(c), (v), memory_order_relaxed)
+#define COUNTER_ADD(c, n) COUNTER_STORE(c, COUNTER_LOAD(c) + (n))
+
+/**
+ * @brief open an update of the bus counters, readers retry until bus_stats_end().
+ *
+ * Only the thread driving the bus writes its counters, so plain load/store pairs are
+ * enough; a reset asked for by pwm_stats_reset() is applied here.
+ *
+ * @param bus bus being accounted.
+ */
+static void bus_stats_begin(struct pwm_bus *bus)
+{
+    COUNTER_STORE(bus->stats_seq, COUNTER_LOAD(bus->stats_seq) + 1);
+    atomic_thread_fence(memory_order_release);
+
+    unsigned reset = COUNTER_LOAD(bus->stats_reset);
+    if (reset != COUNTER_LOAD(bus->stats_reset_done)) {
+        for (int c = 0; c < PWM_REG_CLASSES; c++) {
+            struct pwm_bus_counters *stats = &bus->stats[c];
+            COUNTER_STORE(stats->transactions, 0);
+            COUNTER_STORE(stats->bytes, 0);
+            COUNTER_STORE(stats->retries, 0);
+            COUNTER_STORE(stats->short_writes, 0);
+            COUNTER_STORE(stats->errors, 0);
+            COUNTER_STORE(stats->total_latency_ns, 0);
+            COUNTER_STORE(stats->max_latency_ns, 0);
+            for (int i = 0; i < PWM_STATS_BUCKETS; i++) {
+                COUNTER_STORE(stats->latency_hist[i], 0);
+            }
+        }
+        COUNTER_STORE(bus->stats_reset_done, reset);
+    }
+}
+
+static void bus_stats_end(struct pwm_bus *bus)
+{
+    atomic_store_explicit(&bus->stats_seq, COUNTER_LOAD(bus->stats_seq) + 1,
+                          memory_order_release);
+}
+
+/**
+ * @brief run one bus transaction with retries and account for it.
+ *
+ * @param bus bus to use.
+ * @param msgs messages, the first one a write starting with the register address.
+ * @param nmsgs number of messages.
+ * @return 0 on success, -1 on error (errno from the last attempt).
+ */
+static int bus_transfer(struct pwm_bus *bus, struct i2c_msg *msgs, int nmsgs)
+{
+    struct pwm_bus_counters *stats = &bus->stats[reg_class_of(msgs[0].buf[0])];
+    struct pwm_transport *t = &bus->transport;
+    struct timespec start, end;
+    unsigned long retries = 0, short_writes = 0, bytes = 0;
+    int ret = -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int attempt = 0; attempt <= PWM_MAX_RETRIES; attempt++) {
+        if (attempt > 0) {
+            retries++;
+        }
+        ret = t->transfer(t, msgs, nmsgs);
+        if (ret == nmsgs) {
+            break;
+        }
+        if (ret >= 0) {
+            short_writes++;
+            errno = EIO;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    unsigned long ns = (end.tv_sec - start.tv_sec) * 1000000000UL + end.tv_nsec - start.tv_nsec;
+    for (int i = 0; i < nmsgs; i++) {
+        bytes += msgs[i].len + 1; // + address byte
+    }
+
+    // published in one go, readers see the whole transaction or none of it
+    bus_stats_begin(bus);
+    COUNTER_ADD(stats->transactions, 1);
+    COUNTER_ADD(stats->bytes, bytes);
+    COUNTER_ADD(stats->retries, retries);
+    COUNTER_ADD(stats->short_writes, short_writes);
+    COUNTER_ADD(stats->total_latency_ns, ns);
+    if (ns > COUNTER_LOAD(stats->max_latency_ns)) {
+        COUNTER_STORE(stats->max_latency_ns, ns);
+    }
+    COUNTER_ADD(stats->latency_hist[latency_bucket(ns)], 1);
+    if (ret != nmsgs) {
+        COUNTER_ADD(stats->errors, 1);
+    }
+    bus_stats_end(bus);
+
+    return ret == nmsgs ? 0 : -1;
+}
+
+/**
+ * @brief Keep the mode/prescale part of the shadow in step with register writes.
+ *
+ * @param ctrl controller written to.
+ * @param reg Register address.
+ * @param val Value written.
+ */
+static void shadow_track_reg(struct pca9685 *ctrl, uint8_t reg, uint8_t val)
+{
+    struct pca9685_shadow *shadow = &ctrl->shadow;
+    if (reg == MODE1) {
+        shadow->mode1 = val & ~MODE1_RESTART; // restart bit clears itself
+    } else if (reg == MODE2) {
+        shadow->mode2 = val;
+    } else if (reg == PRE_SCALE) {
+        shadow->prescale = val;
+    } else if (reg >= channel0_ON_L && reg < channel0_ON_L + MAX_BURST_LEN) {
+        // single register writes (set_pwm fallback) are tracked per channel by the caller
+        shadow->valid &= ~(1u << ((reg - channel0_ON_L) / channel_MULTIPLIER));
+    }
+}
+
+/**
+ * @brief write a block of consecutive registers of one controller in one transfer.
+ *
+ * @param ctrl controller.
+ * @param reg First register address.
+ * @param vals Values to write, starting at reg.
+ * @param len Number of values (at most MAX_BURST_LEN).
+ * @return 0 on success, -1 on error.
+ */
+static int ctrl_write(struct pca9685 *ctrl, uint8_t reg, const uint8_t *vals, int len)
+{
+    uint8_t buf[1 + MAX_BURST_LEN];
+    struct i2c_msg msg;
+
+    if (len < 0 || len > MAX_BURST_LEN) {
+        fprintf(stderr, "Burst length %d out of range\n", len);
+        return -1;
+    }
+    buf[0] = reg;
+    for (int i = 0; i < len; i++) {
+        buf[1 + i] = vals[i];
+    }
+    if (len == 1) {
+        shadow_track_reg(ctrl, reg, vals[0]);
+    }
+
+    msg.addr = ctrl->addr;
+    msg.flags = 0;
+    msg.len = len + 1;
+    msg.buf = buf;
+    return bus_transfer(ctrl->bus, &msg, 1);
+}
+
+/**
+ * @brief read one register of a controller.
+ *
+ * @param ctrl controller.
+ * @param reg Register address.
+ * @param val Read byte, out.
+ * @return 0 on success, -1 on error.
+ */
+static int ctrl_read(struct pca9685 *ctrl, uint8_t reg, uint8_t *val)
+{
+    uint8_t addr_buf[1];
+    struct i2c_msg msgs[2];
+
+    addr_buf[0] = reg;
+    msgs[0].addr = ctrl->addr;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = addr_buf;
+    msgs[1].addr = ctrl->addr;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = 1;
+    msgs[1].buf = val;
+
+    return bus_transfer(ctrl->bus, msgs, 2);
+}
+
+/**
+ * @brief MODE2 value for the current latch mode.
+ */
+static uint8_t mode2_value(void)
+{
+    return MODE2_OUTDRV | (latch_mode == PWM_LATCH_ACK ? MODE2_OCH : 0);
+}
+
+/**
+ * @brief choose when written channel values reach the outputs.
+ *
+ * PWM_LATCH_STOP (the default) holds every register written in a transaction until its
+ * STOP. A frame is sent as one transfer per bus, so all channels of all controllers on
+ * a bus switch together and a channel never runs with a new ON and an old OFF value.
+ * PWM_LATCH_ACK updates each channel as soon as its four registers are written, which
+ * lets early channels of a long transfer move sooner at the cost of skew between them.
+ *
+ * @param mode latch mode.
+ */
+void pwm_set_latch_mode(enum pwm_latch_mode mode)
+{
+    latch_mode = mode;
+    for (int c = 0; c < num_controllers; c++) {
+        uint8_t val = mode2_value();
+        ctrl_write(&controllers[c], MODE2, &val, 1);
+    }
+}
+
+enum pwm_latch_mode pwm_get_latch_mode(void)
+{
+    return latch_mode;
+}
+
+/**
+ * @brief sets the pwm frequency of one controller.
+ *
+ * @param ctrl controller.
+ * @param freq Frequency value.
+ */
+static void ctrl_set_freq(struct pca9685 *ctrl, int freq)
+{
+    int prescale = freq > 0 ? PWM_PRESCALE(freq) : 255;
+    // the chip only takes 3..255, i.e. roughly 24..1526 Hz
+    if (prescale < 3) {
+        prescale = 3;
+    } else if (prescale > 255) {
+        prescale = 255;
+    }
+    uint8_t prescale_val = (uint8_t)prescale;
+    uint8_t val;
+    val = MODE1_SLEEP | MODE1_AI | MODE1_ALLCALL; // sleep
+    ctrl_write(ctrl, MODE1, &val, 1);
+    ctrl_write(ctrl, PRE_SCALE, &prescale_val, 1);
+    val = MODE1_RESTART | MODE1_AI | MODE1_ALLCALL; // restart
+    ctrl_write(ctrl, MODE1, &val, 1);
+    val = mode2_value(); // totem pole, output change per latch mode
+    ctrl_write(ctrl, MODE2, &val, 1);
+}
+
+/**
+ * @brief bytes on the wire for writing the channels in a mask as auto-increment runs.
+ *
+ * Every run costs the address byte, the register pointer and 4 bytes per channel.
+ */
+static int runs_cost(uint16_t mask)
+{
+    int cost = 0;
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        if (i == 0 || !(mask & (1u << (i - 1)))) {
+            cost += 2;
+        }
+        cost += channel_MULTIPLIER;
+    }
+    return cost;
+}
+
+/**
+ * @brief decide how the staged channels of a controller go out.
+ *
+ * When all 16 channels end up with the same values, one ALL_LED write is cheaper than
+ * the staged runs. That needs the final value of every channel, so it is only tried
+ * when the untouched channels are known from the shadow. A pose that merely shares a
+ * value with most channels is not broadcast: the channels that differ, a gripper for
+ * instance, would glitch to the broadcast value until patched. With the ALL_LED path
+ * taken, staged is widened to every channel so the shadow learns the values written.
+ *
+ * @param ctrl controller with staged channels.
+ * @param plan result.
+ */
+static void plan_controller(struct pca9685 *ctrl, struct flush_plan *plan)
+{
+    uint16_t on[NUM_CHANNELS], off[NUM_CHANNELS];
+
+    plan->use_all = 0;
+    plan->patch = ctrl->staged;
+
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+        if (ctrl->staged & (1u << i)) {
+            on[i] = ctrl->staged_on[i];
+            off[i] = ctrl->staged_off[i];
+        } else if (ctrl->shadow.valid & (1u << i)) {
+            on[i] = ctrl->shadow.on[i];
+            off[i] = ctrl->shadow.off[i];
+        } else {
+            return;
+        }
+        if (on[i] != on[0] || off[i] != off[0]) {
+            return;
+        }
+    }
+    if (2 + channel_MULTIPLIER >= runs_cost(ctrl->staged)) {
         return;
     }
 
-    if (ioctl(i2c_fd, I2C_SLAVE, PCA9685_SLAVE_ADDR) < 0) {
-        perror("Error to set i2c address");
-        close(i2c_fd);
+    plan->use_all = 1;
+    plan->all_on = on[0];
+    plan->all_off = off[0];
+    plan->patch = 0;
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+        ctrl->staged_on[i] = on[i];
+        ctrl->staged_off[i] = off[i];
+    }
+    ctrl->staged = 0xFFFF;
+}
+
+/**
+ * @brief append an ALL_LED write to a message list.
+ *
+ * @return bytes used in buf.
+ */
+static int add_all_msg(struct i2c_msg *msg, uint8_t *buf, uint16_t addr, int on_value,
+                       int off_value)
+{
+    msg->addr = addr;
+    msg->flags = 0;
+    msg->len = 1 + channel_MULTIPLIER;
+    msg->buf = buf;
+    buf[0] = ALLchannel_ON_L;
+    buf[1] = on_value & 0xFF;
+    buf[2] = on_value >> 8;
+    buf[3] = off_value & 0xFF;
+    buf[4] = off_value >> 8;
+    return 1 + channel_MULTIPLIER;
+}
+
+/**
+ * @brief flush the staged channels of every controller on a bus in one transaction.
+ *
+ * Every run of consecutive staged channels of a controller becomes one auto-increment
+ * message; the messages of all controllers on the bus go out in a single transfer.
+ * A controller whose 16 channels all end up with the same value, staged or already in
+ * the shadow, gets a single ALL_LED write instead (see plan_controller()), and when
+ * every controller on the bus broadcasts the same value it is sent once to the
+ * ALL_CALL address.
+ *
+ * @param bus bus to flush.
+ */
+static void bus_flush(struct pwm_bus *bus)
+{
+    uint8_t buf[MAX_CONTROLLERS * (1 + channel_MULTIPLIER + MAX_BURST_LEN + NUM_CHANNELS)];
+    struct i2c_msg msgs[MAX_CONTROLLERS * (1 + NUM_CHANNELS / 2)];
+    struct flush_plan plans[MAX_CONTROLLERS];
+    int nmsgs = 0;
+    int used = 0;
+    int on_bus = 0, broadcasting = 0, allcall = 0;
+
+    for (int c = 0; c < num_controllers; c++) {
+        struct pca9685 *ctrl = &controllers[c];
+        if (ctrl->bus != bus) {
+            continue;
+        }
+        on_bus++;
+        if (!ctrl->staged) {
+            continue;
+        }
+        plan_controller(ctrl, &plans[c]);
+        if (!plans[c].use_all) {
+            continue;
+        }
+        if (broadcasting == 0) {
+            allcall = c;
+        } else if (plans[c].all_on != plans[allcall].all_on
+                   || plans[c].all_off != plans[allcall].all_off) {
+            allcall = -1;
+        }
+        broadcasting++;
+    }
+    if (on_bus < 2 || broadcasting < on_bus || allcall < 0) {
+        allcall = -1;
+    } else {
+        used += add_all_msg(&msgs[nmsgs++], &buf[used], PCA9685_ALLCALL_ADDR,
+                            plans[allcall].all_on, plans[allcall].all_off);
+    }
+
+    for (int c = 0; c < num_controllers; c++) {
+        struct pca9685 *ctrl = &controllers[c];
+        if (ctrl->bus != bus || !ctrl->staged) {
+            continue;
+        }
+        if (plans[c].use_all && allcall < 0) {
+            used += add_all_msg(&msgs[nmsgs++], &buf[used], ctrl->addr, plans[c].all_on,
+                                plans[c].all_off);
+        }
+        uint16_t mask = plans[c].patch;
+        for (int i = 0; i < NUM_CHANNELS; i++) {
+            if (!(mask & (1u << i))) {
+                continue;
+            }
+            // start a new message unless this channel extends the previous run
+            if (i == 0 || !(mask & (1u << (i - 1)))) {
+                msgs[nmsgs].addr = ctrl->addr;
+                msgs[nmsgs].flags = 0;
+                msgs[nmsgs].len = 1;
+                msgs[nmsgs].buf = &buf[used];
+                buf[used++] = channel0_ON_L + channel_MULTIPLIER * i;
+                nmsgs++;
+            }
+            buf[used++] = ctrl->staged_on[i] & 0xFF;
+            buf[used++] = ctrl->staged_on[i] >> 8;
+            buf[used++] = ctrl->staged_off[i] & 0xFF;
+            buf[used++] = ctrl->staged_off[i] >> 8;
+            msgs[nmsgs - 1].len += channel_MULTIPLIER;
+        }
+    }
+    if (nmsgs == 0) {
         return;
     }
 
-    // init
-    write_byte(MODE1, 0x00);
-    write_byte(MODE2, 0x04);
+    int err = bus_transfer(bus, msgs, nmsgs);
+    if (err < 0) {
+        perror("Error committing pwm frame");
+    }
+    for (int c = 0; c < num_controllers; c++) {
+        struct pca9685 *ctrl = &controllers[c];
+        if (ctrl->bus != bus || !ctrl->staged) {
+            continue;
+        }
+        for (int i = 0; i < NUM_CHANNELS; i++) {
+            if (!(ctrl->staged & (1u << i))) {
+                continue;
+            }
+            if (err < 0) {
+                // part of the transfer may have landed
+                ctrl->shadow.valid &= ~(1u << i);
+            } else {
+                ctrl->shadow.on[i] = ctrl->staged_on[i];
+                ctrl->shadow.off[i] = ctrl->staged_off[i];
+                ctrl->shadow.valid |= 1u << i;
+            }
+        }
+        ctrl->staged = 0;
+    }
+}
+
+/**
+ * @brief writer thread of a bus, flushes whenever a commit hands it work.
+ */
+static void *bus_writer(void *arg)
+{
+    struct pwm_bus *bus = arg;
+
+    pthread_mutex_lock(&bus->lock);
+    while (1) {
+        while (!bus->flush_pending && bus->writer_running) {
+            pthread_cond_wait(&bus->cond, &bus->lock);
+        }
+        if (!bus->writer_running) {
+            break;
+        }
+        pthread_mutex_unlock(&bus->lock);
+        bus_flush(bus);
+        pthread_mutex_lock(&bus->lock);
+        bus->flush_pending = 0;
+        pthread_cond_broadcast(&bus->cond);
+    }
+    pthread_mutex_unlock(&bus->lock);
+    return NULL;
+}
+
+/**
+ * @brief Initialize the PCA9685 module i2c
+ *
+ * Without any pwm_add_bus()/pwm_add_controller() calls this sets up one controller at
+ * PCA9685_SLAVE_ADDR on I2C_DEVICE, using the transport set with pwm_set_transport();
+ * without one, PWM_TRANSPORT=sim in the environment selects the simulated device,
+ * anything else the real bus. With more than one bus, every bus gets a writer thread
+ * so frames are flushed to all buses at the same time.
+ */
+void PCA9685_init()
+{
+    if (!default_transport) {
+        const char *name = getenv("PWM_TRANSPORT");
+        if (name && strcmp(name, pca9685_sim_transport.name) == 0) {
+            default_transport = &pca9685_sim_transport;
+        } else {
+            default_transport = &pwm_transport_i2cdev;
+        }
+    }
+    if (num_buses == 0) {
+        pwm_add_bus(I2C_DEVICE, default_transport);
+    }
+    if (num_controllers == 0) {
+        pwm_add_controller(0, PCA9685_SLAVE_ADDR);
+    }
+
+    // logical channels without an explicit mapping follow the controllers in order
+    if (!joint_map_ready) {
+        for (int i = 0; i < MAX_JOINTS; i++) {
+            joint_map[i].controller = -1;
+        }
+        joint_map_ready = 1;
+    }
+    for (int i = 0; i < MAX_JOINTS; i++) {
+        if (joint_map[i].controller < 0 && i / NUM_CHANNELS < num_controllers) {
+            joint_map[i].controller = i / NUM_CHANNELS;
+            joint_map[i].channel = i % NUM_CHANNELS + 1;
+        }
+    }
+
+    for (int b = 0; b < num_buses; b++) {
+        struct pwm_transport *t = &buses[b].transport;
+        if (t->open(t, buses[b].device) < 0) {
+            return;
+        }
+    }
+
+    for (int c = 0; c < num_controllers; c++) {
+        struct pca9685 *ctrl = &controllers[c];
+        uint8_t val;
+
+        // channel registers survive a restart of this program, so nothing is known yet
+        ctrl->shadow.valid = 0;
+        ctrl->staged = 0;
+
+        // init, auto-increment on so a channel can be written in one burst, ALL_CALL kept
+        // on so every chip on a bus can be written at once
+        val = MODE1_AI | MODE1_ALLCALL;
+        ctrl_write(ctrl, MODE1, &val, 1);
+        val = mode2_value();
+        ctrl_write(ctrl, MODE2, &val, 1);
+    }
+
+    set_pwm_freq(SERVO_PWM_FREQ);
 
-    set_pwm_freq(50);
+    if (num_buses > 1) {
+        for (int b = 0; b < num_buses; b++) {
+            buses[b].writer_running = 1;
+            if (pthread_create(&buses[b].writer, NULL, bus_writer, &buses[b]) != 0) {
+                fprintf(stderr, "Cannot start writer for %s\n", buses[b].device);
+                buses[b].writer_running = 0;
+            }
+        }
+    }
+}
+
+/**
+ * @brief stop the bus writer threads and close the buses.
+ */
+void PCA9685_close(void)
+{
+    for (int b = 0; b < num_buses; b++) {
+        struct pwm_bus *bus = &buses[b];
+        if (bus->writer_running) {
+            pthread_mutex_lock(&bus->lock);
+            bus->writer_running = 0;
+            pthread_cond_broadcast(&bus->cond);
+            pthread_mutex_unlock(&bus->lock);
+            pthread_join(bus->writer, NULL);
+        }
+        bus->transport.close(&bus->transport);
+    }
 }
 
 /**
- * @brief Write a byte to the specified register.
+ * @brief Write a byte to the specified register of the first controller.
  *
  * @param reg Register adress.
  * @param val Value to write.
+ * @return 0 on success, -1 on error.
  */
-void write_byte(uint8_t reg, uint8_t val)
+int write_byte(uint8_t reg, uint8_t val)
 {
-    uint8_t buf[2];
-    buf[0] = reg;
-    buf[1] = val;
-    if (write(i2c_fd, buf, 2) != 2) {
+    if (ctrl_write(&controllers[0], reg, &val, 1) < 0) {
         perror("Error writing byte");
-        return;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Write a block of consecutive registers of the first controller in one transfer.
+ *
+ * Relies on MODE1 auto-increment, so the device must have been initialised with
+ * PCA9685_init().
+ *
+ * @param reg First register address.
+ * @param vals Values to write, starting at reg.
+ * @param len Number of values (at most MAX_BURST_LEN).
+ * @return 0 on success, -1 on error.
+ */
+int write_bytes(uint8_t reg, const uint8_t *vals, int len)
+{
+    if (ctrl_write(&controllers[0], reg, vals, len) < 0) {
+        perror("Error writing burst");
+        return -1;
     }
+    return 0;
 }
 
 /**
- * @brief Reads a bytes from the specified register.
+ * @brief Reads a bytes from the specified register of the first controller.
  *
  * @param reg Register address
  * @return Read byte.
  */
 uint8_t read_byte(uint8_t reg)
 {
-    uint8_t buf[1];
-    buf[0] = reg;
-    if (write(i2c_fd, buf, 1) != 1) {
-        perror("Write faichannel");
-        return 0;
-    }
-    if (read(i2c_fd, buf, 1) != 1) {
+    uint8_t val = 0;
+    if (ctrl_read(&controllers[0], reg, &val) < 0) {
         perror("Read faichannel");
         return 0;
     }
-    return buf[0];
+    return val;
 }
 
 /**
- * @brief sets pwm frequency.
+ * @brief sets pwm frequency of every controller.
  *
  * @param freq Frequency value.
  */
 void set_pwm_freq(int freq)
 {
-    uint8_t prescale_val = (uint8_t)((CLOCK_FREQ / 4096 * freq) - 1);
-    write_byte(MODE1, 0x10); // sleep
-    write_byte(PRE_SCALE, prescale_val);
-    write_byte(MODE1, 0x80); // restart
-    write_byte(MODE2, 0x04); // totem pole (default)
+    for (int c = 0; c < num_controllers; c++) {
+        ctrl_set_freq(&controllers[c], freq);
+    }
+
+    // tick length changed, keep the pulse widths in time
+    pwm_lut_build(calibration, MAX_JOINTS);
 }
 
 /**
@@ -86,36 +858,294 @@ void set_pwm_freq(int freq)
  */
 void set_pwm_duty(uint8_t channel, int value)
 {
-    set_pwm(channel, 0, value);
+    set_pwm_burst(channel, 0, value);
+}
+
+/**
+ * @brief check whether a controller channel already holds the given values.
+ *
+ * @param ctrl controller.
+ * @param channel channel number on the controller.
+ * @param on_value ON value.
+ * @param off_value OFF value.
+ * @return 1 if the write can be skipped.
+ */
+static int shadow_matches(const struct pca9685 *ctrl, int channel, int on_value, int off_value)
+{
+    int idx = channel - 1;
+    return (ctrl->shadow.valid & (1u << idx)) && ctrl->shadow.on[idx] == on_value
+        && ctrl->shadow.off[idx] == off_value;
+}
+
+/**
+ * @brief record the values a channel holds after a successful write.
+ *
+ * @param ctrl controller.
+ * @param channel channel number on the controller.
+ * @param on_value ON value.
+ * @param off_value OFF value.
+ */
+static void shadow_store(struct pca9685 *ctrl, int channel, int on_value, int off_value)
+{
+    int idx = channel - 1;
+    ctrl->shadow.on[idx] = on_value;
+    ctrl->shadow.off[idx] = off_value;
+    ctrl->shadow.valid |= 1u << idx;
 }
 
 /**
- * @brief sets the pwm parameters for a specific channel.
+ * @brief sets the pwm parameters for a specific channel, one register per message.
+ *
+ * Slow fallback for set_pwm_burst(), works without MODE1 auto-increment. The four
+ * messages share one transfer, so the channel never latches half written.
  *
  * @param channel channel number.
  * @param on_value ON value.
+ * @param off_value OFF value.
  */
 void set_pwm(uint8_t channel, int on_value, int off_value)
 {
-    write_byte(channel0_ON_L + channel_MULTIPLIER * (channel - 1), on_value & 0xFF);
-    write_byte(channel0_ON_L + channel_MULTIPLIER * (channel - 1) + 1, on_value >> 8);
-    write_byte(channel0_OFF_L + channel_MULTIPLIER * (channel - 1), off_value & 0xFF);
-    write_byte(channel0_OFF_L + channel_MULTIPLIER * (channel - 1) + 1, off_value >> 8);
+    if (capture) {
+        pwm_frame_set(capture, channel, on_value, off_value);
+        return;
+    }
+    int ch;
+    struct pca9685 *ctrl = joint_controller(channel, &ch);
+    if (!ctrl) {
+        fprintf(stderr, "Channel %d not mapped\n", channel);
+        return;
+    }
+    if (shadow_matches(ctrl, ch, on_value, off_value)) {
+        return;
+    }
+    uint8_t reg = channel0_ON_L + channel_MULTIPLIER * (ch - 1);
+    uint8_t vals[channel_MULTIPLIER];
+    vals[0] = on_value & 0xFF;
+    vals[1] = on_value >> 8;
+    vals[2] = off_value & 0xFF;
+    vals[3] = off_value >> 8;
+
+    // one register per message, but all in one transfer so they latch at the same STOP
+    uint8_t buf[channel_MULTIPLIER][2];
+    struct i2c_msg msgs[channel_MULTIPLIER];
+    for (int i = 0; i < channel_MULTIPLIER; i++) {
+        buf[i][0] = reg + i;
+        buf[i][1] = vals[i];
+        msgs[i].addr = ctrl->addr;
+        msgs[i].flags = 0;
+        msgs[i].len = 2;
+        msgs[i].buf = buf[i];
+    }
+    if (bus_transfer(ctrl->bus, msgs, channel_MULTIPLIER) == 0) {
+        shadow_store(ctrl, ch, on_value, off_value);
+    } else {
+        ctrl->shadow.valid &= ~(1u << (ch - 1));
+        perror("Error writing channel");
+    }
+}
+
+/**
+ * @brief sets the pwm parameters for a specific channel in a single transfer.
+ *
+ * ON_L, ON_H, OFF_L and OFF_H are sent as one 5-byte write using auto-increment.
+ *
+ * @param channel channel number.
+ * @param on_value ON value.
+ * @param off_value OFF value.
+ */
+void set_pwm_burst(uint8_t channel, int on_value, int off_value)
+{
+    if (capture) {
+        pwm_frame_set(capture, channel, on_value, off_value);
+        return;
+    }
+    int ch;
+    struct pca9685 *ctrl = joint_controller(channel, &ch);
+    if (!ctrl) {
+        fprintf(stderr, "Channel %d not mapped\n", channel);
+        return;
+    }
+    if (shadow_matches(ctrl, ch, on_value, off_value)) {
+        return;
+    }
+
+    uint8_t vals[channel_MULTIPLIER];
+    vals[0] = on_value & 0xFF;
+    vals[1] = on_value >> 8;
+    vals[2] = off_value & 0xFF;
+    vals[3] = off_value >> 8;
+    if (ctrl_write(ctrl, channel0_ON_L + channel_MULTIPLIER * (ch - 1), vals, channel_MULTIPLIER)
+        == 0) {
+        shadow_store(ctrl, ch, on_value, off_value);
+    } else {
+        perror("Error writing burst");
+    }
 }
 
 /**
  * @brief reads the pwm value of a specific channel.
  *
+ * Served from the shadow; the device is only read for a channel not written since
+ * PCA9685_init() or pwm_shadow_invalidate().
+ *
  * @param channel channel number.
  * @return pwm value.
  */
 int get_pwm(uint8_t channel)
 {
-    int channel_value = 0;
-    channel_value = read_byte(channel0_OFF_L + channel_MULTIPLIER * (channel - 1));
-    channel_value |= (read_byte(channel0_OFF_L + channel_MULTIPLIER * (channel - 1) + 1) << 8);
+    int ch;
+    struct pca9685 *ctrl = joint_controller(channel, &ch);
+    if (!ctrl) {
+        return 0;
+    }
+    int idx = ch - 1;
+    if (!(ctrl->shadow.valid & (1u << idx))) {
+        uint8_t reg = channel0_ON_L + channel_MULTIPLIER * idx;
+        uint8_t vals[channel_MULTIPLIER] = { 0 };
+        for (int i = 0; i < channel_MULTIPLIER; i++) {
+            if (ctrl_read(ctrl, reg + i, &vals[i]) < 0) {
+                perror("Read faichannel");
+                return 0;
+            }
+        }
+        shadow_store(ctrl, ch, vals[0] | (vals[1] << 8), vals[2] | (vals[3] << 8));
+    }
+
+    return ctrl->shadow.off[idx];
+}
+
+/**
+ * @brief build the per-channel angle to tick tables.
+ *
+ * Each entry is the OFF tick count for a whole degree in LUT_FRAC_BITS fixed point,
+ * scaled from the calibration pulse widths (ticks at LUT_REF_PRESCALE) to the
+ * prescaler currently set on the channel's controller, so the servos keep the same
+ * pulse length in time.
+ *
+ * @param cal calibration of channels 1..num_channels, NULL or 0 widths for defaults.
+ * @param num_channels number of entries in cal.
+ */
+void pwm_lut_build(const struct CalibrationData *cal, int num_channels)
+{
+    for (int ch = 0; ch < MAX_JOINTS; ch++) {
+        if (cal && ch < num_channels && cal != calibration) {
+            calibration[ch] = cal[ch];
+        }
+        int hw_ch;
+        struct pca9685 *ctrl = joint_controller(ch + 1, &hw_ch);
+        int prescale = (ctrl && ctrl->shadow.prescale) ? ctrl->shadow.prescale : LUT_REF_PRESCALE;
+        double scale = (double)(LUT_REF_PRESCALE + 1) / (prescale + 1) * (1 << LUT_FRAC_BITS);
 
-    return channel_value;
+        int min_width = calibration[ch].min_pulse_width;
+        int max_width = calibration[ch].max_pulse_width;
+        if (min_width == 0 && max_width == 0) {
+            min_width = MIN_PULSE_WIDTH;
+            max_width = MAX_PULSE_WIDTH;
+        }
+        for (int deg = 0; deg <= ANGLE_RANGE; deg++) {
+            double ticks = min_width + (double)(max_width - min_width) * deg / ANGLE_RANGE;
+            double fixed = ticks * scale + 0.5;
+            if (fixed > (4095 << LUT_FRAC_BITS)) {
+                fixed = 4095 << LUT_FRAC_BITS;
+            } else if (fixed < 0) {
+                fixed = 0;
+            }
+            angle_lut[ch][deg] = (uint16_t)fixed;
+        }
+    }
+}
+
+/**
+ * @brief read servo calibration written by pwm_calibration_save().
+ *
+ * One "channel min max" line per channel; channels missing from the file are left as
+ * they are in cal.
+ *
+ * @param path calibration file.
+ * @param cal calibration of channels 1..num_channels, updated.
+ * @param num_channels number of entries in cal.
+ * @return number of channels read, -1 if the file can't be opened.
+ */
+int pwm_calibration_load(const char *path, struct CalibrationData *cal, int num_channels)
+{
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+
+    int channel, min_width, max_width, count = 0;
+    while (fscanf(file, "%d %d %d", &channel, &min_width, &max_width) == 3) {
+        if (channel < 1 || channel > num_channels) {
+            fprintf(stderr, "%s: channel %d out of range, skipped\n", path, channel);
+            continue;
+        }
+        cal[channel - 1].min_pulse_width = min_width;
+        cal[channel - 1].max_pulse_width = max_width;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+/**
+ * @brief write servo calibration for pwm_calibration_load().
+ *
+ * @param path calibration file, replaced.
+ * @param cal calibration of channels 1..num_channels.
+ * @param num_channels number of entries in cal.
+ * @return 0 on success, -1 on error.
+ */
+int pwm_calibration_save(const char *path, const struct CalibrationData *cal, int num_channels)
+{
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    for (int ch = 0; ch < num_channels; ch++) {
+        fprintf(file, "%d %d %d\n", ch + 1, cal[ch].min_pulse_width, cal[ch].max_pulse_width);
+    }
+    if (fclose(file) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief convert a servo angle to an OFF tick value through the channel table.
+ *
+ * The angle is clamped to 0 - ANGLE_RANGE and interpolated between the two nearest
+ * whole-degree entries in fixed point, so fractions of a degree are kept.
+ *
+ * @param channel channel number (1 - MAX_JOINTS).
+ * @param angle Angle in degrees.
+ * @return pulse width in ticks, -1 if the channel is out of range.
+ */
+int angle_to_ticks(uint8_t channel, float angle)
+{
+    if (channel < 1 || channel > MAX_JOINTS) {
+        fprintf(stderr, "Channel %d out of range\n", channel);
+        return -1;
+    }
+    if (!(angle > 0.0f)) { // also catches NaN
+        angle = 0.0f;
+    } else if (angle > ANGLE_RANGE) {
+        angle = ANGLE_RANGE;
+    }
+
+    const uint16_t *lut = angle_lut[channel - 1];
+    uint32_t fixed = (uint32_t)(angle * (1 << LUT_ANGLE_FRAC_BITS));
+    uint32_t idx = fixed >> LUT_ANGLE_FRAC_BITS;
+    uint32_t frac = fixed & ((1 << LUT_ANGLE_FRAC_BITS) - 1);
+    if (idx >= ANGLE_RANGE) {
+        return (lut[ANGLE_RANGE] + (1 << (LUT_FRAC_BITS - 1))) >> LUT_FRAC_BITS;
+    }
+
+    int32_t step = (int32_t)lut[idx + 1] - (int32_t)lut[idx];
+    int32_t value = lut[idx] + ((step * (int32_t)frac) >> LUT_ANGLE_FRAC_BITS);
+    return (value + (1 << (LUT_FRAC_BITS - 1))) >> LUT_FRAC_BITS;
 }
 
 /**
@@ -123,20 +1153,437 @@ int get_pwm(uint8_t channel)
  *
  * @param channel channel number.
  * @param angle Angle value (0 - 180)
- * @param freq PWM frequency
  */
 void set_pwm_angle(uint8_t channel, int angle)
 {
-    if (angle < 0) {
-        angle = 0;
-    } else if (angle > 180) {
-        angle = 180;
+    int ticks = angle_to_ticks(channel, angle);
+    if (ticks >= 0) {
+        set_pwm_duty(channel, ticks);
+    }
+}
+
+/**
+ * @brief set the pwm angle for a servo motor with sub-degree resolution.
+ *
+ * @param channel channel number.
+ * @param angle Angle value (0 - 180)
+ */
+void set_pwm_angle_f(uint8_t channel, float angle)
+{
+    int ticks = angle_to_ticks(channel, angle);
+    if (ticks >= 0) {
+        set_pwm_duty(channel, ticks);
+    }
+}
+
+/**
+ * @brief initialise an empty frame.
+ *
+ * Channels the caller does not touch are not committed and keep their current output.
+ * The shadow is not read: it belongs to the committing thread, which may be writing it
+ * while the planner builds the next frame.
+ *
+ * @param frame frame to fill.
+ */
+void pwm_frame_init(struct pwm_frame *frame)
+{
+    memset(frame, 0, sizeof(*frame));
+}
+
+/**
+ * @brief stage the pwm parameters of one channel in a frame.
+ *
+ * @param frame target frame.
+ * @param channel channel number (1 - MAX_JOINTS).
+ * @param on_value ON value.
+ * @param off_value OFF value.
+ */
+void pwm_frame_set(struct pwm_frame *frame, uint8_t channel, int on_value, int off_value)
+{
+    if (channel < 1 || channel > MAX_JOINTS) {
+        fprintf(stderr, "Channel %d out of range\n", channel);
+        return;
+    }
+    frame->on[channel - 1] = on_value;
+    frame->off[channel - 1] = off_value;
+    frame->touched |= 1ull << (channel - 1);
+}
+
+/**
+ * @brief stage a servo angle for one channel in a frame.
+ *
+ * @param frame target frame.
+ * @param channel channel number.
+ * @param angle Angle value (0 - 180)
+ */
+void pwm_frame_set_angle(struct pwm_frame *frame, uint8_t channel, int angle)
+{
+    int ticks = angle_to_ticks(channel, angle);
+    if (ticks >= 0) {
+        pwm_frame_set(frame, channel, 0, ticks);
+    }
+}
+
+/**
+ * @brief stage a servo angle with sub-degree resolution for one channel in a frame.
+ *
+ * @param frame target frame.
+ * @param channel channel number.
+ * @param angle Angle value (0 - 180)
+ */
+void pwm_frame_set_angle_f(struct pwm_frame *frame, uint8_t channel, float angle)
+{
+    int ticks = angle_to_ticks(channel, angle);
+    if (ticks >= 0) {
+        pwm_frame_set(frame, channel, 0, ticks);
+    }
+}
+
+/**
+ * @brief route set_pwm()/set_pwm_angle() calls into a frame instead of the bus.
+ *
+ * Lets code written against the per-channel API (e.g. set_angles()) build a whole
+ * frame; the capture ends with pwm_frame_commit().
+ *
+ * @param frame frame to collect into, initialised with pwm_frame_init().
+ */
+void pwm_frame_begin(struct pwm_frame *frame)
+{
+    capture = frame;
+}
+
+/**
+ * @brief stop routing channel writes into a frame without committing it.
+ *
+ * @param frame frame passed to pwm_frame_begin().
+ */
+void pwm_frame_end(struct pwm_frame *frame)
+{
+    if (capture == frame) {
+        capture = NULL;
+    }
+}
+
+/**
+ * @brief send the changed channels of a frame to the controllers.
+ *
+ * Channels whose staged values already match the shadow are skipped. Each bus gets
+ * one transaction holding the changes for all of its controllers. When the frame
+ * touches more than one bus, the bus writer threads flush them concurrently and the
+ * call returns once every bus is done.
+ *
+ * @param frame frame to commit.
+ */
+void pwm_frame_commit(struct pwm_frame *frame)
+{
+    int bus_dirty[MAX_BUSES] = { 0 };
+    int dirty_buses = 0;
+
+    pwm_frame_end(frame);
+
+    uint64_t touched = frame->touched;
+    while (touched) {
+        int i = __builtin_ctzll(touched);
+        touched &= touched - 1;
+
+        int ch;
+        struct pca9685 *ctrl = joint_controller(i + 1, &ch);
+        if (!ctrl || shadow_matches(ctrl, ch, frame->on[i], frame->off[i])) {
+            continue;
+        }
+        ctrl->staged_on[ch - 1] = frame->on[i];
+        ctrl->staged_off[ch - 1] = frame->off[i];
+        ctrl->staged |= 1u << (ch - 1);
+
+        int b = ctrl->bus - buses;
+        if (!bus_dirty[b]) {
+            bus_dirty[b] = 1;
+            dirty_buses++;
+        }
+    }
+    if (dirty_buses == 0) {
+        return;
+    }
+
+    // a single bus is cheaper to flush here than to hand over to its writer
+    if (dirty_buses == 1) {
+        for (int b = 0; b < num_buses; b++) {
+            if (bus_dirty[b]) {
+                bus_flush(&buses[b]);
+            }
+        }
+        return;
+    }
+
+    for (int b = 0; b < num_buses; b++) {
+        if (!bus_dirty[b]) {
+            continue;
+        }
+        if (!buses[b].writer_running) {
+            bus_flush(&buses[b]);
+            bus_dirty[b] = 0;
+            continue;
+        }
+        pthread_mutex_lock(&buses[b].lock);
+        buses[b].flush_pending = 1;
+        pthread_cond_broadcast(&buses[b].cond);
+        pthread_mutex_unlock(&buses[b].lock);
+    }
+    for (int b = 0; b < num_buses; b++) {
+        if (!bus_dirty[b]) {
+            continue;
+        }
+        pthread_mutex_lock(&buses[b].lock);
+        while (buses[b].flush_pending) {
+            pthread_cond_wait(&buses[b].cond, &buses[b].lock);
+        }
+        pthread_mutex_unlock(&buses[b].lock);
+    }
+}
+
+/**
+ * @brief set every channel of every controller to the same values.
+ *
+ * Each bus gets a single ALL_LED write, sent to the ALL_CALL address when the bus
+ * carries more than one controller. ALL_CALL reaches every PCA9685 on the bus that has
+ * it enabled, registered or not. Buses whose shadow already holds the values are skipped.
+ *
+ * @param on_value ON value.
+ * @param off_value OFF value (LED_FULL for output off).
+ * @return 0 on success, -1 if any bus failed.
+ */
+int pwm_set_all(int on_value, int off_value)
+{
+    int ret = 0;
+
+    for (int b = 0; b < num_buses; b++) {
+        struct i2c_msg msgs[MAX_CONTROLLERS];
+        uint8_t buf[MAX_CONTROLLERS][1 + channel_MULTIPLIER];
+        int nmsgs = 0, on_bus = 0, unchanged = 0;
+
+        for (int c = 0; c < num_controllers; c++) {
+            const struct pca9685_shadow *shadow = &controllers[c].shadow;
+            if (controllers[c].bus != &buses[b]) {
+                continue;
+            }
+            on_bus++;
+            int same = shadow->valid == 0xFFFF;
+            for (int i = 0; same && i < NUM_CHANNELS; i++) {
+                same = shadow->on[i] == on_value && shadow->off[i] == off_value;
+            }
+            unchanged += same;
+        }
+        // the shadow says every output already runs these values
+        if (unchanged == on_bus) {
+            continue;
+        }
+        if (on_bus > 1) {
+            add_all_msg(&msgs[nmsgs++], buf[0], PCA9685_ALLCALL_ADDR, on_value, off_value);
+        } else if (on_bus == 1) {
+            for (int c = 0; c < num_controllers; c++) {
+                if (controllers[c].bus == &buses[b]) {
+                    add_all_msg(&msgs[nmsgs++], buf[0], controllers[c].addr, on_value,
+                                off_value);
+                }
+            }
+        } else {
+            continue;
+        }
+
+        int err = bus_transfer(&buses[b], msgs, nmsgs);
+        if (err < 0) {
+            perror("Error writing all channels");
+            ret = -1;
+        }
+        for (int c = 0; c < num_controllers; c++) {
+            struct pca9685 *ctrl = &controllers[c];
+            if (ctrl->bus != &buses[b]) {
+                continue;
+            }
+            for (int i = 0; i < NUM_CHANNELS; i++) {
+                ctrl->shadow.on[i] = on_value;
+                ctrl->shadow.off[i] = off_value;
+            }
+            ctrl->shadow.valid = err < 0 ? 0 : 0xFFFF;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief switch every output off, one transaction per bus.
+ *
+ * Servos go limp; the next frame or set_pwm() brings a channel back.
+ */
+int pwm_all_off(void)
+{
+    return pwm_set_all(0, LED_FULL);
+}
+
+/**
+ * @brief stage the same servo angle on a set of channels of a frame.
+ *
+ * Only the given channels are touched, servos that are not part of the pose (the
+ * gripper) keep their output. When the set covers all 16 channels of a controller and
+ * they share a calibration, the commit sends them as one ALL_LED write.
+ *
+ * @param frame target frame.
+ * @param channels bit n set: stage channel n+1, see PWM_CHANNEL_MASK().
+ * @param angle Angle value (0 - 180)
+ */
+void pwm_frame_set_all_angle(struct pwm_frame *frame, uint64_t channels, float angle)
+{
+    for (int joint = 1; joint <= MAX_JOINTS; joint++) {
+        int ch;
+        if ((channels & (1ull << (joint - 1))) && joint_controller(joint, &ch)) {
+            pwm_frame_set_angle_f(frame, joint, angle);
+        }
+    }
+}
+
+/**
+ * @brief consistent copy of the counters of one bus and register class.
+ *
+ * Safe from any thread and never blocks the one driving the bus; retries if a
+ * transaction was accounted while copying.
+ *
+ * @param bus bus to read.
+ * @param reg_class register class.
+ * @param out destination.
+ */
+static void bus_stats_snapshot(struct pwm_bus *bus, enum pwm_reg_class reg_class,
+                               struct pwm_bus_stats *out)
+{
+    const struct pwm_bus_counters *s = &bus->stats[reg_class];
+    unsigned seq;
+    do {
+        while ((seq = atomic_load_explicit(&bus->stats_seq, memory_order_acquire)) & 1) {
+            sched_yield();
+        }
+        memset(out, 0, sizeof(*out));
+        // a reset not yet applied by the bus thread already reads as zero
+        if (COUNTER_LOAD(bus->stats_reset) == COUNTER_LOAD(bus->stats_reset_done)) {
+            out->transactions = COUNTER_LOAD(s->transactions);
+            out->bytes = COUNTER_LOAD(s->bytes);
+            out->retries = COUNTER_LOAD(s->retries);
+            out->short_writes = COUNTER_LOAD(s->short_writes);
+            out->errors = COUNTER_LOAD(s->errors);
+            out->total_latency_ns = COUNTER_LOAD(s->total_latency_ns);
+            out->max_latency_ns = COUNTER_LOAD(s->max_latency_ns);
+            for (int i = 0; i < PWM_STATS_BUCKETS; i++) {
+                out->latency_hist[i] = COUNTER_LOAD(s->latency_hist[i]);
+            }
+        }
+        atomic_thread_fence(memory_order_acquire);
+    } while (COUNTER_LOAD(bus->stats_seq) != seq);
+}
+
+/**
+ * @brief bus counters of one register class, summed over all buses.
+ *
+ * @param reg_class register class.
+ * @param stats destination.
+ */
+void pwm_stats_get(enum pwm_reg_class reg_class, struct pwm_bus_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int b = 0; b < num_buses; b++) {
+        struct pwm_bus_stats s;
+        bus_stats_snapshot(&buses[b], reg_class, &s);
+        stats->transactions += s.transactions;
+        stats->bytes += s.bytes;
+        stats->retries += s.retries;
+        stats->short_writes += s.short_writes;
+        stats->errors += s.errors;
+        stats->total_latency_ns += s.total_latency_ns;
+        if (s.max_latency_ns > stats->max_latency_ns) {
+            stats->max_latency_ns = s.max_latency_ns;
+        }
+        for (int i = 0; i < PWM_STATS_BUCKETS; i++) {
+            stats->latency_hist[i] += s.latency_hist[i];
+        }
     }
+}
 
-    int pulse_width = MIN_PULSE_WIDTH + ((MAX_PULSE_WIDTH - MIN_PULSE_WIDTH) * angle / 180);
+/**
+ * @brief zero all bus counters.
+ *
+ * Only asks for the reset, the thread driving each bus clears its counters before
+ * accounting the next transaction; snapshots read zero in between.
+ */
+void pwm_stats_reset(void)
+{
+    for (int b = 0; b < num_buses; b++) {
+        atomic_fetch_add(&buses[b].stats_reset, 1);
+    }
+}
 
-    set_pwm_duty(channel, pulse_width);
+/**
+ * @brief print the bus counters and latency histograms of every bus and register class.
+ *
+ * Works on snapshots, so it can run while the output thread drives the buses.
+ *
+ * @param out output stream.
+ */
+void pwm_stats_dump(FILE *out)
+{
+    for (int b = 0; b < num_buses; b++) {
+        fprintf(out, "i2c bus stats %s (%s):\n", buses[b].device, buses[b].transport.name);
+        for (int c = 0; c < PWM_REG_CLASSES; c++) {
+            struct pwm_bus_stats snapshot;
+            const struct pwm_bus_stats *s = &snapshot;
+            bus_stats_snapshot(&buses[b], c, &snapshot);
+            if (s->transactions == 0) {
+                continue;
+            }
+            fprintf(out,
+                    "  %-8s txn %lu bytes %lu retries %lu short %lu errors %lu "
+                    "latency us mean %.1f max %.1f\n",
+                    reg_class_names[c], s->transactions, s->bytes, s->retries, s->short_writes,
+                    s->errors, s->total_latency_ns / 1e3 / s->transactions,
+                    s->max_latency_ns / 1e3);
+            fprintf(out, "           hist us:");
+            for (int i = 0; i < PWM_STATS_BUCKETS; i++) {
+                if (s->latency_hist[i]) {
+                    fprintf(out, " <%lu:%lu", 1UL << i, s->latency_hist[i]);
+                }
+            }
+            fprintf(out, "\n");
+        }
+    }
+}
 
+/**
+ * @brief access the register shadow of the first controller.
+ *
+ * @return shadow of the device registers.
+ */
+const struct pca9685_shadow *pwm_shadow(void)
+{
+    return &controllers[0].shadow;
+}
 
+/**
+ * @brief access the register shadow of a controller.
+ *
+ * @param controller controller index.
+ * @return shadow of the device registers, NULL for a bad index.
+ */
+const struct pca9685_shadow *pwm_controller_shadow(int controller)
+{
+    return (controller >= 0 && controller < num_controllers) ? &controllers[controller].shadow
+                                                             : NULL;
 }
 
+/**
+ * @brief forget the cached channel values, the next write of every channel hits the bus.
+ *
+ * Use after anything that may have changed the devices behind our back (power loss,
+ * another process on the bus).
+ */
+void pwm_shadow_invalidate(void)
+{
+    for (int c = 0; c < num_controllers; c++) {
+        controllers[c].shadow.valid = 0;
+    }
+}
@@ -2,17 +2,29 @@
 #define PWM_SERVO_H
 
 #include <fcntl.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
 #define I2C_DEVICE "/dev/i2c-2"
 #define PCA9685_SLAVE_ADDR 0x40
+#define PCA9685_ALLCALL_ADDR 0x70 // power-on ALLCALLADR (0xE0) as a 7-bit address
 #define MODE1 0x00 // Mode  register  1
 #define MODE2 0x01 // Mode  register  2
+#define MODE1_RESTART 0x80 // MODE1: restart enabled
+#define MODE1_AI 0x20 // MODE1: register auto-increment enabled
+#define MODE1_SLEEP 0x10 // MODE1: low power mode, oscillator off
+#define MODE1_ALLCALL 0x01 // MODE1: respond to the ALL_CALL address
+#define MODE2_OCH 0x08 // MODE2: outputs change on ACK instead of on STOP
+#define MODE2_OUTDRV 0x04 // MODE2: totem pole outputs
 #define SUBADR1 0x02 // I2C-bus subaddress 1
 #define SUBADR2 0x03 // I2C-bus subaddress 2
 #define SUBADR3 0x04 // I2C-bus subaddress 3
@@ -28,23 +40,196 @@
 #define ALLchannel_OFF_L 0xFC // load all the channeln_OFF registers, byte 0 (turn 0-7 channels off)
 #define ALLchannel_OFF_H                                                                           \
     0xFD // load all the channeln_OFF registers, byte 1 (turn 8-15 channels off)
+#define NUM_CHANNELS 16 // channels per PCA9685
+#define MAX_BUSES 4 // I2C buses carrying PCA9685s
+#define MAX_CONTROLLERS 8 // PCA9685s over all buses
+#define MAX_JOINTS 64 // logical channels, each mapped to a (controller, channel) pair
+#define PWM_CHANNEL_MASK(first, last) /* channels first..last as a pwm_frame touched set */       \
+    ((~0ull >> (63 - ((last) - (first)))) << ((first) - 1))
+#define MAX_BURST_LEN (NUM_CHANNELS * channel_MULTIPLIER) // longest auto-increment data block
+#define LED_FULL 0x1000 // ON_H/OFF_H bit 4: channel fully on/off (power-on OFF value)
 #define PRE_SCALE 0xFE // prescaler for output frequency
 #define CLOCK_FREQ 25000000.0 // 25MHz default osc clock
 #define ANGLE_RANGE 180
-#define MIN_PULSE_WIDTH 400
-#define MAX_PULSE_WIDTH 2600
+#define PWM_PRESCALE(freq) /* PRE_SCALE value for an output frequency, rounded */                \
+    ((int)(CLOCK_FREQ / (4096.0 * (freq)) + 0.5) - 1)
+#define SERVO_PWM_FREQ 50 // output frequency set by PCA9685_init
+#define MIN_PULSE_WIDTH 75 // 0.37 ms at 50 Hz
+#define MAX_PULSE_WIDTH 490 // 2.39 ms at 50 Hz
+#define LUT_REF_PRESCALE PWM_PRESCALE(SERVO_PWM_FREQ) // pulse widths are ticks at this prescaler
+#define LUT_FRAC_BITS 4 // fixed-point fraction bits of the angle table entries
+#define LUT_ANGLE_FRAC_BITS 8 // fixed-point fraction bits of a looked-up angle
+#define PWM_CALIBRATION_FILE "servo_calibration.txt" // written by calibrate_servo
 
-extern int i2c_fd;
+/* Pulse widths (ticks at LUT_REF_PRESCALE) of a servo at 0 and 180 degrees */
+struct CalibrationData
+{
+    int min_pulse_width;
+    int max_pulse_width;
+};
+
+/* Register image of all logical channels, committed to the devices in one go */
+struct pwm_frame
+{
+    uint16_t on[MAX_JOINTS];
+    uint16_t off[MAX_JOINTS];
+    uint64_t touched; // bit n set: channel n+1 was staged with pwm_frame_set()
+};
+
+/* In-memory copy of the device registers, lets unchanged writes and reads skip the bus */
+struct pca9685_shadow
+{
+    uint8_t mode1;
+    uint8_t mode2;
+    uint8_t prescale;
+    uint16_t on[NUM_CHANNELS];
+    uint16_t off[NUM_CHANNELS];
+    uint16_t valid; // bit n set: channel n+1 is known to match the device
+};
+
+/* I2C bus backend, each transfer() is one combined transaction ending in a single STOP
+ * and returns the number of messages sent (like I2C_RDWR) or -1 */
+struct pwm_transport
+{
+    const char *name;
+    int (*open)(struct pwm_transport *t, const char *device);
+    void (*close)(struct pwm_transport *t);
+    int (*transfer)(struct pwm_transport *t, struct i2c_msg *msgs, int nmsgs);
+    int fd;
+    void *priv;
+};
+
+/* When written channel registers reach the outputs (MODE2 OCH) */
+enum pwm_latch_mode
+{
+    PWM_LATCH_STOP, // at the STOP ending the transaction, whole frames switch at once
+    PWM_LATCH_ACK // per channel, on the ACK of its last register
+};
+
+/* Register classes the bus statistics are grouped by */
+enum pwm_reg_class
+{
+    PWM_REG_MODE, // MODE1 .. ALLCALLADR
+    PWM_REG_CHANNEL, // channel ON/OFF registers
+    PWM_REG_ALL, // ALL_LED broadcast registers
+    PWM_REG_PRESCALE,
+    PWM_REG_CLASSES
+};
+
+#define PWM_MAX_RETRIES 2 // extra attempts for a failed transaction
+#define PWM_STATS_BUCKETS 16 // latency histogram, bucket n counts [2^(n-1), 2^n) us
+
+/* Transaction counters of one register class */
+struct pwm_bus_stats
+{
+    unsigned long transactions;
+    unsigned long bytes; // bytes on the wire, register pointers and reads included
+    unsigned long retries;
+    unsigned long short_writes; // transfers that stopped before their last message
+    unsigned long errors; // transactions that failed after all retries
+    unsigned long long total_latency_ns;
+    unsigned long max_latency_ns;
+    unsigned long latency_hist[PWM_STATS_BUCKETS];
+};
+
+/* Live counters behind struct pwm_bus_stats, written only by the thread driving the bus */
+struct pwm_bus_counters
+{
+    atomic_ulong transactions;
+    atomic_ulong bytes;
+    atomic_ulong retries;
+    atomic_ulong short_writes;
+    atomic_ulong errors;
+    atomic_ullong total_latency_ns;
+    atomic_ulong max_latency_ns;
+    atomic_ulong latency_hist[PWM_STATS_BUCKETS];
+};
+
+/* One I2C bus, flushed from its own writer thread when frames span several buses */
+struct pwm_bus
+{
+    char device[32];
+    struct pwm_transport transport;
+    struct pwm_bus_counters stats[PWM_REG_CLASSES];
+    atomic_uint stats_seq; // seqlock over stats, odd while a transaction is accounted
+    atomic_uint stats_reset; // resets requested by pwm_stats_reset()
+    atomic_uint stats_reset_done; // resets applied by the thread driving the bus
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int writer_running;
+    int flush_pending; // set by the committing thread, cleared by the writer
+};
+
+/* One PCA9685 and the channel values waiting to be flushed to it */
+struct pca9685
+{
+    struct pwm_bus *bus;
+    uint8_t addr;
+    struct pca9685_shadow shadow; // owned by the committing thread, the output thread while it runs
+    uint16_t staged_on[NUM_CHANNELS];
+    uint16_t staged_off[NUM_CHANNELS];
+    uint16_t staged; // bit n set: channel n+1 has a staged value that differs from the shadow
+};
+
+/* Where a logical channel lives */
+struct pwm_joint
+{
+    int8_t controller; // -1 when unmapped
+    uint8_t channel; // 1 - NUM_CHANNELS
+};
+
+extern struct pwm_transport pwm_transport_i2cdev;
+
+void pwm_set_transport(struct pwm_transport *t);
+struct pwm_transport *pwm_get_transport(void);
+
+int pwm_add_bus(const char *device, const struct pwm_transport *transport);
+int pwm_add_controller(int bus, uint8_t addr);
+int pwm_map_joint(uint8_t joint, int controller, uint8_t channel);
+int pwm_num_controllers(void);
+struct pca9685 *pwm_get_controller(int index);
 
 void PCA9685_init();
-void write_byte(uint8_t reg, uint8_t val);
+void PCA9685_close(void);
+void pwm_set_latch_mode(enum pwm_latch_mode mode);
+enum pwm_latch_mode pwm_get_latch_mode(void);
+int write_byte(uint8_t reg, uint8_t val);
+int write_bytes(uint8_t reg, const uint8_t *vals, int len);
 void set_pwm_freq(int freq);
 void set_pwm_duty(uint8_t channel, int value);
 void set_pwm(uint8_t channel, int on_value, int off_value);
+void set_pwm_burst(uint8_t channel, int on_value, int off_value);
 void set_pwm_angle(uint8_t channel, int angle);
+void set_pwm_angle_f(uint8_t channel, float angle);
+
+void pwm_lut_build(const struct CalibrationData *cal, int num_channels);
+int pwm_calibration_load(const char *path, struct CalibrationData *cal, int num_channels);
+int pwm_calibration_save(const char *path, const struct CalibrationData *cal, int num_channels);
+int angle_to_ticks(uint8_t channel, float angle);
 
 int get_pwm(uint8_t channel);
 
+void pwm_frame_init(struct pwm_frame *frame);
+void pwm_frame_set(struct pwm_frame *frame, uint8_t channel, int on_value, int off_value);
+void pwm_frame_set_angle(struct pwm_frame *frame, uint8_t channel, int angle);
+void pwm_frame_set_angle_f(struct pwm_frame *frame, uint8_t channel, float angle);
+void pwm_frame_begin(struct pwm_frame *frame);
+void pwm_frame_end(struct pwm_frame *frame);
+void pwm_frame_set_all_angle(struct pwm_frame *frame, uint64_t channels, float angle);
+void pwm_frame_commit(struct pwm_frame *frame);
+
+int pwm_set_all(int on_value, int off_value);
+int pwm_all_off(void);
+
+void pwm_stats_get(enum pwm_reg_class reg_class, struct pwm_bus_stats *stats);
+void pwm_stats_reset(void);
+void pwm_stats_dump(FILE *out);
+
+const struct pca9685_shadow *pwm_shadow(void);
+const struct pca9685_shadow *pwm_controller_shadow(int controller);
+void pwm_shadow_invalidate(void);
+
 uint8_t read_byte(uint8_t reg);
 
 #endif /*PWM_SERVO_H*/
\ No newline at end of file
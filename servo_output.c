@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "servo_output.h"
+
+#define NSEC_PER_SEC 1000000000L
+
+// single producer (planner) / single consumer (output thread) ring of pose frames
+static struct pwm_frame queue[SERVO_OUTPUT_QUEUE_LEN];
+static atomic_uint queue_head; // next slot the planner writes
+static atomic_uint queue_tail; // next slot the output thread reads
+
+static pthread_t output_thread;
+static atomic_int running;
+static long period_ns;
+
+/* Timing counters, written only by the output thread and read by anyone through a
+ * seqlock: the writer makes seq odd while it updates, readers retry until they copy
+ * the fields between two equal even values. No lock, so the SCHED_FIFO thread never
+ * waits on a reader. */
+static atomic_uint stats_seq;
+static atomic_ulong stats_periods;
+static atomic_ulong stats_commits;
+static atomic_ulong stats_underruns;
+static atomic_ulong stats_overruns;
+static atomic_long stats_last_slack_ns;
+static atomic_long stats_min_slack_ns;
+static atomic_long stats_max_slack_ns;
+static atomic_llong stats_total_slack_ns;
+
+static void timespec_add_ns(struct timespec *ts, long ns)
+{
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= NSEC_PER_SEC) {
+        ts->tv_nsec -= NSEC_PER_SEC;
+        ts->tv_sec++;
+    }
+}
+
+static long timespec_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec - b->tv_sec) * NSEC_PER_SEC + (a->tv_nsec - b->tv_nsec);
+}
+
+/**
+ * @brief take the oldest queued frame.
+ *
+ * @param frame destination.
+ * @return 1 if a frame was dequeued, 0 if the queue was empty.
+ */
+static int queue_pop(struct pwm_frame *frame)
+{
+    unsigned tail = atomic_load_explicit(&queue_tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&queue_head, memory_order_acquire);
+    if (tail == head) {
+        return 0;
+    }
+    *frame = queue[tail % SERVO_OUTPUT_QUEUE_LEN];
+    atomic_store_explicit(&queue_tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+#define STATS_LOAD(field) atomic_load_explicit(&(field), memory_order_relaxed)
+#define STATS_STORE(field, value) atomic_store_explicit(&(field), (value), memory_order_relaxed)
+
+/**
+ * @brief open a stats update, readers retry until stats_write_end().
+ */
+static void stats_write_begin(void)
+{
+    unsigned seq = STATS_LOAD(stats_seq);
+    STATS_STORE(stats_seq, seq + 1);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void stats_write_end(void)
+{
+    atomic_store_explicit(&stats_seq, STATS_LOAD(stats_seq) + 1, memory_order_release);
+}
+
+static void record_period(int committed, long slack_ns)
+{
+    stats_write_begin();
+    STATS_STORE(stats_periods, STATS_LOAD(stats_periods) + 1);
+    if (committed) {
+        STATS_STORE(stats_commits, STATS_LOAD(stats_commits) + 1);
+    } else {
+        STATS_STORE(stats_underruns, STATS_LOAD(stats_underruns) + 1);
+    }
+    if (slack_ns < 0) {
+        STATS_STORE(stats_overruns, STATS_LOAD(stats_overruns) + 1);
+    }
+    STATS_STORE(stats_last_slack_ns, slack_ns);
+    if (slack_ns < STATS_LOAD(stats_min_slack_ns)) {
+        STATS_STORE(stats_min_slack_ns, slack_ns);
+    }
+    if (slack_ns > STATS_LOAD(stats_max_slack_ns)) {
+        STATS_STORE(stats_max_slack_ns, slack_ns);
+    }
+    STATS_STORE(stats_total_slack_ns, STATS_LOAD(stats_total_slack_ns) + slack_ns);
+    stats_write_end();
+}
+
+/**
+ * @brief output loop, wakes on absolute deadlines and commits at most one frame per period.
+ */
+static void *output_loop(void *arg)
+{
+    (void)arg;
+    struct timespec deadline, now;
+    struct pwm_frame frame;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    while (atomic_load(&running)) {
+        timespec_add_ns(&deadline, period_ns);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        }
+
+        int committed = queue_pop(&frame);
+        if (committed) {
+            pwm_frame_commit(&frame);
+        }
+
+        // slack: how much of this period is left before the next wake-up
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long slack_ns = period_ns - timespec_diff_ns(&now, &deadline);
+        record_period(committed, slack_ns);
+
+        // after an overrun start counting periods from now instead of bursting to catch up
+        if (slack_ns < 0) {
+            deadline = now;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief start the output thread.
+ *
+ * Runs under SCHED_FIFO with memory locked when permitted; without the privileges it
+ * falls back to normal scheduling and says so.
+ *
+ * @param rate_hz output rate, frames per second.
+ * @return 0 on success, -1 on error.
+ */
+int servo_output_start(int rate_hz)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+
+    if (atomic_load(&running) || rate_hz <= 0) {
+        return -1;
+    }
+    period_ns = NSEC_PER_SEC / rate_hz;
+
+    // the output thread is not running yet, so this is the only writer
+    stats_write_begin();
+    STATS_STORE(stats_periods, 0);
+    STATS_STORE(stats_commits, 0);
+    STATS_STORE(stats_underruns, 0);
+    STATS_STORE(stats_overruns, 0);
+    STATS_STORE(stats_last_slack_ns, 0);
+    STATS_STORE(stats_min_slack_ns, LONG_MAX);
+    STATS_STORE(stats_max_slack_ns, LONG_MIN);
+    STATS_STORE(stats_total_slack_ns, 0);
+    stats_write_end();
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        perror("mlockall");
+    }
+
+    atomic_store(&running, 1);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    param.sched_priority = SERVO_OUTPUT_PRIORITY;
+    pthread_attr_setschedparam(&attr, &param);
+
+    int err = pthread_create(&output_thread, &attr, output_loop, NULL);
+    if (err == EPERM) {
+        fprintf(stderr, "servo output: no permission for SCHED_FIFO, using default scheduling\n");
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        err = pthread_create(&output_thread, &attr, output_loop, NULL);
+    }
+    pthread_attr_destroy(&attr);
+
+    if (err != 0) {
+        fprintf(stderr, "servo output: pthread_create failed (%d)\n", err);
+        atomic_store(&running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief stop the output thread, frames still queued are dropped.
+ */
+void servo_output_stop(void)
+{
+    if (!atomic_load(&running)) {
+        return;
+    }
+    atomic_store(&running, 0);
+    pthread_join(output_thread, NULL);
+    atomic_store(&queue_tail, atomic_load(&queue_head));
+}
+
+int servo_output_is_running(void)
+{
+    return atomic_load(&running);
+}
+
+/**
+ * @brief queue a frame for the output thread without blocking.
+ *
+ * @param frame frame to send.
+ * @return 0 if queued, -1 if the queue is full.
+ */
+int servo_output_push(const struct pwm_frame *frame)
+{
+    unsigned head = atomic_load_explicit(&queue_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&queue_tail, memory_order_acquire);
+    if (head - tail >= SERVO_OUTPUT_QUEUE_LEN) {
+        return -1;
+    }
+    queue[head % SERVO_OUTPUT_QUEUE_LEN] = *frame;
+    atomic_store_explicit(&queue_head, head + 1, memory_order_release);
+    return 0;
+}
+
+/**
+ * @brief hand a finished pose frame to the output stage.
+ *
+ * Ends a pwm_frame_begin() capture. With the output thread running the frame is
+ * queued, waiting for a free slot, which paces the planner to the output rate;
+ * otherwise it is committed directly.
+ *
+ * @param frame frame to send.
+ */
+void servo_output_submit(struct pwm_frame *frame)
+{
+    pwm_frame_end(frame);
+    if (!atomic_load(&running)) {
+        pwm_frame_commit(frame);
+        return;
+    }
+    struct timespec wait = { 0, period_ns / 4 };
+    while (servo_output_push(frame) < 0 && atomic_load(&running)) {
+        nanosleep(&wait, NULL);
+    }
+}
+
+/**
+ * @brief consistent copy of the output loop timing counters, safe from any thread.
+ *
+ * Never blocks the output thread; retries if a period was recorded while copying.
+ */
+void servo_output_get_stats(struct servo_output_stats *out)
+{
+    unsigned seq;
+    do {
+        while ((seq = atomic_load_explicit(&stats_seq, memory_order_acquire)) & 1) {
+            sched_yield();
+        }
+        out->periods = STATS_LOAD(stats_periods);
+        out->commits = STATS_LOAD(stats_commits);
+        out->underruns = STATS_LOAD(stats_underruns);
+        out->overruns = STATS_LOAD(stats_overruns);
+        out->last_slack_ns = STATS_LOAD(stats_last_slack_ns);
+        out->min_slack_ns = STATS_LOAD(stats_min_slack_ns);
+        out->max_slack_ns = STATS_LOAD(stats_max_slack_ns);
+        out->total_slack_ns = STATS_LOAD(stats_total_slack_ns);
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&stats_seq, memory_order_relaxed) != seq);
+}
+
+/**
+ * @brief print the output loop timing counters.
+ */
+void servo_output_print_stats(FILE *out)
+{
+    struct servo_output_stats s;
+    servo_output_get_stats(&s);
+    if (s.periods == 0) {
+        fprintf(out, "servo output: no periods run\n");
+        return;
+    }
+    fprintf(out,
+            "servo output: periods %lu commits %lu underruns %lu overruns %lu\n"
+            "slack us: last %.1f min %.1f mean %.1f max %.1f (period %.1f)\n",
+            s.periods, s.commits, s.underruns, s.overruns, s.last_slack_ns / 1e3,
+            s.min_slack_ns / 1e3, (double)s.total_slack_ns / s.periods / 1e3, s.max_slack_ns / 1e3,
+            period_ns / 1e3);
+}
@@ -0,0 +1,34 @@
+#ifndef SERVO_OUTPUT_H
+#define SERVO_OUTPUT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "pwm_servo.h"
+
+#define SERVO_OUTPUT_RATE_HZ 100 // default output rate
+#define SERVO_OUTPUT_QUEUE_LEN 8 // frames buffered between planner and output thread, power of 2
+#define SERVO_OUTPUT_PRIORITY 80 // SCHED_FIFO priority of the output thread
+
+struct servo_output_stats
+{
+    unsigned long periods; // periods run since start
+    unsigned long commits; // frames sent to the bus
+    unsigned long underruns; // periods without a queued frame, last pose held
+    unsigned long overruns; // periods that finished after their deadline
+    long last_slack_ns; // time left before the next deadline after the last commit
+    long min_slack_ns;
+    long max_slack_ns;
+    long long total_slack_ns; // divide by periods for the mean
+};
+
+int servo_output_start(int rate_hz);
+void servo_output_stop(void);
+int servo_output_is_running(void);
+
+int servo_output_push(const struct pwm_frame *frame);
+void servo_output_submit(struct pwm_frame *frame);
+
+void servo_output_get_stats(struct servo_output_stats *stats);
+void servo_output_print_stats(FILE *out);
+
+#endif // SERVO_OUTPUT_H
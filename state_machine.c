@@ -20,7 +20,7 @@ void handle_event(RobotEvent event)
     case STATE_MOVE_FORWARD:
         if (event == EVENT_STOP) {
             current_state == STATE_IDLE;
-            stand_position();
+            return_to_stance(STANCE_SPEED);
             is_program_running = 0;
         }
         break;
@@ -28,7 +28,7 @@ void handle_event(RobotEvent event)
     case STATE_MOVE_LEFT:
         if (event == EVENT_STOP) {
             current_state == STATE_IDLE;
-            stand_position();
+            return_to_stance(STANCE_SPEED);
             is_program_running= 0;
         }
         break;
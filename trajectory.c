@@ -1,7 +1,9 @@
+#include <math.h>
 #include "trajectory.h"
 
-//fungsi untuk menciptakan trajectory swing ke depan
-void generate_swing_phase(struct bezier2d *curve, float startx, float startz, float stride_length, float swing_height, int leg_type)
+//titik kontrol swing: start, puncak ayunan, end
+static void swing_points(float startx, float startz, float stride_length, float swing_height,
+                         int leg_type, float x[3], float z[3])
 {
     float controlx = 0;
     /*ditambahkan dari posisi awal z karena posisi awal adalah negative(-), jadi agar mengangkat kaki maka ketinggian harus dikurangi*/
@@ -17,10 +19,17 @@ void generate_swing_phase(struct bezier2d *curve, float startx, float startz, fl
     }
     float endz = startz;
 
-    bezier2d_generate_curve(curve, startx, startz, controlx, controlz, endx, endz);
+    x[0] = startx;
+    z[0] = startz;
+    x[1] = controlx;
+    z[1] = controlz;
+    x[2] = endx;
+    z[2] = endz;
 }
 
-void generate_stance_phase(struct bezier2d *curve, float startx, float startz, float stride_lenght, int leg_type)
+//titik kontrol stance: kaki menapak dan mendorong ke belakang
+static void stance_points(float startx, float startz, float stride_lenght, int leg_type,
+                          float x[3], float z[3])
 {
     float controlx = 0;
     float controlz = startz - SWING_PUSH_BACK;
@@ -34,41 +43,254 @@ void generate_stance_phase(struct bezier2d *curve, float startx, float startz, f
     }
     float endz = startz;
 
-    bezier2d_generate_curve(curve, startx, startz, controlx, controlz, endx, endz);
+    x[0] = startx;
+    z[0] = startz;
+    x[1] = controlx;
+    z[1] = controlz;
+    x[2] = endx;
+    z[2] = endz;
 }
 
+//fungsi untuk menciptakan trajectory swing ke depan
+int generate_swing_phase(struct bezier2d *curve, float startx, float startz, float stride_length, float swing_height, int leg_type)
+{
+    float x[3], z[3];
+    swing_points(startx, startz, stride_length, swing_height, leg_type, x, z);
+    return bezier2d_generate_curve(curve, x[0], z[0], x[1], z[1], x[2], z[2]);
+}
 
-void generate_walk_trajectory(struct bezier2d *curve, SpiderLeg *leg, float stride_length, float swing_height, LegPosition leg_positions)
+int generate_stance_phase(struct bezier2d *curve, float startx, float startz, float stride_lenght, int leg_type)
+{
+    float x[3], z[3];
+    stance_points(startx, startz, stride_lenght, leg_type, x, z);
+    return bezier2d_generate_curve(curve, x[0], z[0], x[1], z[1], x[2], z[2]);
+}
+
+
+int generate_walk_trajectory(struct bezier2d *curve, SpiderLeg *leg, float stride_length, float swing_height, LegPosition leg_positions)
 {
     //get current position
     float startx_swing = leg->joints[3][0] - stride_length;
     float startz_swing = leg->joints[3][2];
 
     //buat swing phase
-    generate_swing_phase(curve, startx_swing, startz_swing, stride_length, swing_height - 20.0 , FRONT);
+    if (generate_swing_phase(curve, startx_swing, startz_swing, stride_length, swing_height - 20.0 , FRONT) < 0) {
+        return -1;
+    }
 
     //update start position untuk stance phase
     float startx_stance = startx_swing + stride_length;
     float startz_stance = startz_swing;
 
-    generate_stance_phase(curve, startx_stance, startz_stance, stride_length, FRONT);
+    return generate_stance_phase(curve, startx_stance, startz_stance, stride_length, FRONT);
 
 }
 
 //trajectory untuk kaki belakang karena beda orientasi
-void generate_walk_back_leg_trajectory(struct bezier2d *curve, SpiderLeg *leg, float stride_length, float swing_height, LegPosition leg_positions)
+int generate_walk_back_leg_trajectory(struct bezier2d *curve, SpiderLeg *leg, float stride_length, float swing_height, LegPosition leg_positions)
 {
      //get current position
     float startx_swing = leg->joints[3][0];
     float startz_swing = leg->joints[3][2];
 
     //buat swing phase
-    generate_swing_phase(curve, startx_swing, startz_swing, stride_length, swing_height + 20, BACK);
+    if (generate_swing_phase(curve, startx_swing, startz_swing, stride_length, swing_height + 20, BACK) < 0) {
+        return -1;
+    }
 
     //update start position untuk stance phase
     float startx_stance = startx_swing - stride_length;
     float startz_stance = startz_swing;
 
-    generate_stance_phase(curve, startx_stance, startz_stance, stride_length, BACK);
+    return generate_stance_phase(curve, startx_stance, startz_stance, stride_length, BACK);
+
+}
+
+/**
+ * @brief quadratic Bezier control points to power basis coefficients.
+ */
+static void quadratic_coef(const float p[3], float coef[3])
+{
+    coef[0] = p[0];
+    coef[1] = 2.0f * (p[1] - p[0]);
+    coef[2] = p[0] - 2.0f * p[1] + p[2];
+}
+
+static inline float quadratic(const float coef[3], float u)
+{
+    return (coef[2] * u + coef[1]) * u + coef[0];
+}
+
+void trajectory_init(struct trajectory *traj)
+{
+    traj->nsegments = 0;
+}
+
+/**
+ * @brief append a segment to the cycle.
+ *
+ * @param traj trajectory.
+ * @param x control point x of the quadratic segment.
+ * @param z control point z of the quadratic segment.
+ * @param duration share of the cycle, relative to the other segments.
+ * @return 0, -1 when the trajectory is full or the duration is not positive.
+ */
+int trajectory_add_segment(struct trajectory *traj, const float x[3], const float z[3],
+                           float duration)
+{
+    if (traj->nsegments >= TRAJECTORY_MAX_SEGMENTS || duration <= 0.0f) {
+        return -1;
+    }
+    struct trajectory_segment *segment = &traj->segments[traj->nsegments++];
+    segment->duration = duration;
+    quadratic_coef(x, segment->xcoef);
+    quadratic_coef(z, segment->zcoef);
+    return 0;
+}
 
+/**
+ * @brief lay the segments out over phase [0, 1) and build the lookups.
+ *
+ * Durations are normalised to the cycle, the phase buckets record the segment each
+ * bucket starts in and every segment gets its arc length table.
+ *
+ * @param traj trajectory with all segments added.
+ */
+void trajectory_finalize(struct trajectory *traj)
+{
+    enum { nsteps = BEZIER_ARC_SAMPLES * BEZIER_ARC_SUBSTEPS };
+    float total = 0.0f, start = 0.0f;
+
+    for (int i = 0; i < traj->nsegments; i++) {
+        total += traj->segments[i].duration;
+    }
+    for (int i = 0; i < traj->nsegments; i++) {
+        struct trajectory_segment *segment = &traj->segments[i];
+        float span = segment->duration / total;
+        segment->start = start;
+        segment->inv_span = 1.0f / span;
+        start += span;
+
+        float distance[nsteps + 1];
+        float px = segment->xcoef[0], pz = segment->zcoef[0];
+        distance[0] = 0.0f;
+        for (int j = 1; j <= nsteps; j++) {
+            float u = (float)j / nsteps;
+            float x = quadratic(segment->xcoef, u), z = quadratic(segment->zcoef, u);
+            distance[j] = distance[j - 1] + hypotf(x - px, z - pz);
+            px = x;
+            pz = z;
+        }
+        bezier_arc_init(&segment->arc, distance, nsteps);
+    }
+
+    int s = 0;
+    for (int b = 0; b < TRAJECTORY_LOOKUP; b++) {
+        float phase = (float)b / TRAJECTORY_LOOKUP;
+        while (s + 1 < traj->nsegments && traj->segments[s + 1].start <= phase) {
+            s++;
+        }
+        traj->lookup[b] = s;
+    }
+}
+
+/**
+ * @brief segment holding a phase and the segment parameter there.
+ *
+ * The bucket gives the segment at its start; only a segment boundary inside the bucket
+ * can move it on, so this is constant time while no segment is shorter than a bucket.
+ */
+static const struct trajectory_segment *trajectory_find(const struct trajectory *traj,
+                                                        float phase, float *u)
+{
+    phase -= floorf(phase);
+    int s = traj->lookup[(int)(phase * TRAJECTORY_LOOKUP) % TRAJECTORY_LOOKUP];
+    while (s + 1 < traj->nsegments && traj->segments[s + 1].start <= phase) {
+        s++;
+    }
+    const struct trajectory_segment *segment = &traj->segments[s];
+    *u = fminf((phase - segment->start) * segment->inv_span, 1.0f);
+    return segment;
+}
+
+/**
+ * @brief foot position at a phase of the cycle.
+ *
+ * @param traj finalized trajectory.
+ * @param phase cycle phase, taken modulo 1.
+ * @param x foot x, out.
+ * @param z foot z, out.
+ */
+void trajectory_eval(const struct trajectory *traj, float phase, float *x, float *z)
+{
+    float u;
+    if (traj->nsegments == 0) {
+        *x = 0;
+        *z = 0;
+        return;
+    }
+    const struct trajectory_segment *segment = trajectory_find(traj, phase, &u);
+    *x = quadratic(segment->xcoef, u);
+    *z = quadratic(segment->zcoef, u);
+}
+
+/**
+ * @brief foot position at a phase, moving at constant speed within every segment.
+ *
+ * Segments still take their share of the cycle, so duty factors are kept.
+ *
+ * @param traj finalized trajectory.
+ * @param phase cycle phase, taken modulo 1.
+ * @param x foot x, out.
+ * @param z foot z, out.
+ */
+void trajectory_eval_uniform(const struct trajectory *traj, float phase, float *x, float *z)
+{
+    float u;
+    if (traj->nsegments == 0) {
+        *x = 0;
+        *z = 0;
+        return;
+    }
+    const struct trajectory_segment *segment = trajectory_find(traj, phase, &u);
+    u = bezier_arc_lookup(&segment->arc, u * segment->arc.length);
+    *x = quadratic(segment->xcoef, u);
+    *z = quadratic(segment->zcoef, u);
+}
+
+/**
+ * @brief walk cycle of a leg as a swing segment followed by a stance segment.
+ *
+ * Same control points as generate_walk_trajectory() and
+ * generate_walk_back_leg_trajectory(), but each phase stays its own quadratic and
+ * takes its share of the cycle.
+ *
+ * @param traj trajectory to fill.
+ * @param leg leg, the cycle starts from the foot position in joints[3].
+ * @param stride_length stride.
+ * @param swing_height swing height.
+ * @param duty_factor fraction of the cycle the foot is on the ground.
+ * @param leg_positions leg position, the back legs swing the other way.
+ */
+void generate_walk_segments(struct trajectory *traj, SpiderLeg *leg, float stride_length,
+                            float swing_height, float duty_factor, LegPosition leg_positions)
+{
+    float x[3], z[3];
+    float startx = leg->joints[3][0];
+    float startz = leg->joints[3][2];
+
+    trajectory_init(traj);
+    if (leg_positions == KANAN_BELAKANG || leg_positions == KIRI_BELAKANG) {
+        swing_points(startx, startz, stride_length, swing_height + 20, BACK, x, z);
+        trajectory_add_segment(traj, x, z, 1.0f - duty_factor);
+        stance_points(startx - stride_length, startz, stride_length, BACK, x, z);
+        trajectory_add_segment(traj, x, z, duty_factor);
+    } else {
+        swing_points(startx - stride_length, startz, stride_length, swing_height - 20.0, FRONT,
+                     x, z);
+        trajectory_add_segment(traj, x, z, 1.0f - duty_factor);
+        stance_points(startx, startz, stride_length, FRONT, x, z);
+        trajectory_add_segment(traj, x, z, duty_factor);
+    }
+    trajectory_finalize(traj);
 }
@@ -8,9 +8,40 @@
 #define FRONT 1
 #define BACK -1
 
-void generate_swing_phase(struct bezier2d *curve, float startx, float startz, float stride_length, float swing_height, int leg_type);
-void generate_stance_phase(struct bezier2d *curve, float startx, float startz, float stride_leght, int leg_type);
-void generate_walk_trajectory(struct bezier2d *curve, SpiderLeg *leg, float stride_length, float swing_height, LegPosition leg_positions);
-void generate_walk_back_leg_trajectory(struct bezier2d *curve, SpiderLeg *leg, float stride_length, float swing_height, LegPosition leg_positions);
+#define TRAJECTORY_MAX_SEGMENTS 8
+#define TRAJECTORY_LOOKUP 32 // phase buckets mapping a phase to its segment
+
+/* Quadratic Bezier in power basis, coef[k] * u^k over its share of the cycle */
+struct trajectory_segment
+{
+    float duration; // relative, normalised by trajectory_finalize()
+    float start; // phase the segment begins
+    float inv_span; // 1 / phase span, maps phase to the segment parameter u
+    float xcoef[3];
+    float zcoef[3];
+    struct bezier_arc arc; // for constant speed within the segment
+};
+
+/* Foot path of one gait cycle: segments back to back over phase [0, 1) */
+struct trajectory
+{
+    int nsegments;
+    struct trajectory_segment segments[TRAJECTORY_MAX_SEGMENTS];
+    unsigned char lookup[TRAJECTORY_LOOKUP]; // segment at the start of every bucket
+};
+
+int generate_swing_phase(struct bezier2d *curve, float startx, float startz, float stride_length, float swing_height, int leg_type);
+int generate_stance_phase(struct bezier2d *curve, float startx, float startz, float stride_leght, int leg_type);
+int generate_walk_trajectory(struct bezier2d *curve, SpiderLeg *leg, float stride_length, float swing_height, LegPosition leg_positions);
+int generate_walk_back_leg_trajectory(struct bezier2d *curve, SpiderLeg *leg, float stride_length, float swing_height, LegPosition leg_positions);
+
+void trajectory_init(struct trajectory *traj);
+int trajectory_add_segment(struct trajectory *traj, const float x[3], const float z[3],
+                           float duration);
+void trajectory_finalize(struct trajectory *traj);
+void trajectory_eval(const struct trajectory *traj, float phase, float *x, float *z);
+void trajectory_eval_uniform(const struct trajectory *traj, float phase, float *x, float *z);
+void generate_walk_segments(struct trajectory *traj, SpiderLeg *leg, float stride_length,
+                            float swing_height, float duty_factor, LegPosition leg_positions);
 
 #endif //  TRAJECTORY_H
\ No newline at end of file